@@ -0,0 +1,57 @@
+#include "aot.h"
+
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "tiny_exception.h"
+
+namespace tiny {
+
+	void emit_file(llvm::Module& module, llvm::TargetMachine& tm, const std::string& path, OutputKind kind)
+	{
+		std::error_code error;
+		auto flags = kind == OutputKind::Assembly ? llvm::sys::fs::F_Text : llvm::sys::fs::F_None;
+		llvm::raw_fd_ostream out(path, error, flags);
+		if (error)
+			throw TinyException("Could not open output file: " + path + ", " + error.message());
+
+		if (kind == OutputKind::Bitcode)
+		{
+			llvm::WriteBitcodeToFile(&module, out);
+			return;
+		}
+
+		auto file_type = kind == OutputKind::Object ? llvm::TargetMachine::CGFT_ObjectFile : llvm::TargetMachine::CGFT_AssemblyFile;
+
+		llvm::legacy::PassManager passes;
+		if (tm.addPassesToEmitFile(passes, out, file_type))
+			throw TinyException("The target can not emit a file of this type");
+
+		passes.run(module);
+	}
+
+	void link_executable(const std::string& object_path, const std::string& output_path)
+	{
+#ifdef _WIN32
+		const char* linker_name = "link.exe";
+		auto out = "/OUT:" + output_path;
+		const char* args[] = { linker_name, "/NOLOGO", "/SUBSYSTEM:CONSOLE", out.c_str(), object_path.c_str(), "libcmt.lib", nullptr };
+#else
+		const char* linker_name = "cc";
+		const char* args[] = { linker_name, object_path.c_str(), "-o", output_path.c_str(), nullptr };
+#endif
+
+		auto linker = llvm::sys::findProgramByName(linker_name);
+		if (!linker)
+			throw TinyException("Could not find the system linker: " + std::string(linker_name));
+
+		std::string message;
+		auto result = llvm::sys::ExecuteAndWait(linker.get(), args, nullptr, nullptr, 0, 0, &message);
+		if (result != 0)
+			throw TinyException("Linking " + output_path + " failed: " + (message.empty() ? "linker returned " + std::to_string(result) : message));
+	}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "type.h"
+
+namespace tiny {
+
+	enum class OutputKind : u8
+	{
+		Object,
+		Assembly,
+		Bitcode,
+	};
+
+	// Writes module to path, objects and assembly are generated with tm so its triple and data layout have to match
+	// the ones the module was created with
+	void emit_file(llvm::Module& module, llvm::TargetMachine& tm, const std::string& path, OutputKind kind);
+
+	// Links an object into an executable with the system linker, the C runtime provides the entry point that calls main
+	void link_executable(const std::string& object_path, const std::string& output_path);
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+namespace tiny {
+
+	// Bump allocator for everything an AST is made of. All blocks are released at once when the arena is destroyed,
+	// destructors only run for the objects that are not trivially destructible.
+	class Arena
+	{
+	public:
+		Arena() {}
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		~Arena()
+		{
+			for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it)
+				it->destroy(it->object);
+		}
+
+		template<class T, class... TArgs>
+		T* create(TArgs&&... args)
+		{
+			auto object = new (allocator_.Allocate(sizeof(T), alignof(T))) T(std::forward<TArgs>(args)...);
+			register_destructor(object, std::is_trivially_destructible<T>());
+			return object;
+		}
+
+		template<class T>
+		llvm::MutableArrayRef<T> copy(llvm::ArrayRef<T> values)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Arena arrays are never destroyed");
+
+			if (values.empty())
+				return llvm::MutableArrayRef<T>();
+
+			auto memory = allocator_.Allocate<T>(values.size());
+			std::uninitialized_copy(values.begin(), values.end(), memory);
+			return llvm::MutableArrayRef<T>(memory, values.size());
+		}
+
+		llvm::StringRef copy(llvm::StringRef value)
+		{
+			auto chars = copy(llvm::ArrayRef<char>(value.data(), value.size()));
+			return llvm::StringRef(chars.data(), chars.size());
+		}
+
+	private:
+		struct Destructor
+		{
+			void* object;
+			void(*destroy)(void* object);
+		};
+
+		template<class T>
+		static void destroy(void* object)
+		{
+			static_cast<T*>(object)->~T();
+		}
+
+		template<class T>
+		void register_destructor(T* object, std::true_type)
+		{
+		}
+
+		template<class T>
+		void register_destructor(T* object, std::false_type)
+		{
+			destructors_.push_back(Destructor{ object, destroy<T> });
+		}
+
+		llvm::BumpPtrAllocator allocator_;
+		std::vector<Destructor> destructors_;
+	};
+
+}
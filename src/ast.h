@@ -5,8 +5,8 @@
 
 #include "type.h"
 #include "token.h"
-#include "codegen.h"
-#include "symbols.h"
+#include "interner.h"
+#include "arena.h"
 
 namespace tiny {
 
@@ -25,169 +25,136 @@ namespace tiny {
 
 	struct ASTNode
 	{
+		// Nodes live in the AST's arena and are never destroyed individually, so they need to stay trivially destructible
 		ASTNode() : type(nullptr) {}
-		ASTNode(std::unique_ptr<TinyType> t) : type(std::move(t)) {}
-
-		virtual ~ASTNode()
-		{
-		}
+		ASTNode(const TinyType* t) : type(t) {}
 
 		virtual NodeType node_type() = 0;
-		virtual std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) = 0;
 
-		std::unique_ptr<TinyType> type;
+		const TinyType* type;
 	};
 
-	struct Scope
-	{
-		Scope(SymbolTable<TinyType>* parent) : symbol_table_(std::make_unique<SymbolTable<TinyType>>(parent)) {}
-		std::unique_ptr<SymbolTable<TinyType>> symbol_table_;
-	};
+	// Slot or function index of a name that could not be resolved, the parser reports an error for it
+	const u32 unresolved_index = ~0u;
 
-	struct AST : Scope
+	struct AST
 	{
-		AST() : Scope(nullptr) {}
-
-		std::vector<std::unique_ptr<ASTNode>> nodes;
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor)
-		{
-			for (auto& n : nodes)
-				n->codegen(visitor);
-
-			return nullptr;
-		}
+		AST(Interner* i) : function_count(0), interner(i) {}
+
+		// Owns every node, child array and string of the tree
+		Arena arena;
+		TypeContext types;
+		std::vector<ASTNode*> nodes;
+		// Every FnDeclaration has an index below this
+		u32 function_count;
+		// Resolves the names of all nodes, owned by whoever created the Lexer
+		Interner* interner;
 	};
 
 	struct ArgDeclaration : ASTNode
 	{
-		ArgDeclaration(const std::string& n, std::unique_ptr<TinyType> t) : ASTNode(std::move(t)), name(n) {}
+		ArgDeclaration(SymbolId n, const TinyType* t, u32 s) : ASTNode(t), name(n), slot(s) {}
 
-		std::string name;
+		SymbolId name;
+		// Arguments take the first local slots of their function in order
+		u32 slot;
 
 		NodeType node_type() override
 		{
 			return NodeType::ArgDeclaration;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
-	struct FnDeclaration : ASTNode, Scope
+	struct FnDeclaration : ASTNode
 	{
-		FnDeclaration(SymbolTable<TinyType>* parent, bool ext) : ASTNode(std::make_unique<TinyType>(Type::Fn)), Scope(parent), entry_point(false), external(ext) {}
+		FnDeclaration(const TinyType* t, bool ext) : ASTNode(t), index(unresolved_index), local_count(0), entry_point(false), return_type(nullptr), external(ext) {}
 
-		std::string name;
+		SymbolId name;
+		// Position in declaration order, what CallExp::function refers to
+		u32 index;
+		// Number of local slots used by the arguments and variables of the function
+		u32 local_count;
 		bool entry_point;
-		std::unique_ptr<TinyType> return_type;
-		std::vector<std::unique_ptr<ArgDeclaration>> args;
-		std::vector<std::unique_ptr<ASTNode>> body;
+		const TinyType* return_type;
+		llvm::MutableArrayRef<ArgDeclaration*> args;
+		llvm::MutableArrayRef<ASTNode*> body;
 		bool external;
 
 		NodeType node_type() override
 		{
 			return NodeType::FnDeclaration;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 	struct CallExp : ASTNode
 	{
-		CallExp(const std::string& n, std::unique_ptr<TinyType> t) : ASTNode(std::move(t)), name(n) {}
+		CallExp(SymbolId n, const TinyType* t, u32 f) : ASTNode(t), name(n), function(f) {}
 
-		std::string name;
-		std::vector<std::unique_ptr<ASTNode>> args;
+		SymbolId name;
+		u32 function;
+		llvm::MutableArrayRef<ASTNode*> args;
 
 		NodeType node_type() override
 		{
 			return NodeType::CallExp;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 	struct VarDeclaration : ASTNode
 	{
-		VarDeclaration(const std::string& n, std::unique_ptr<ASTNode> exp, std::unique_ptr<TinyType> t, bool ptr) : ASTNode(std::move(t)), name(n), expression(std::move(exp)), pointer(ptr) {}
-		std::string name;
-		std::unique_ptr<ASTNode> expression;
+		VarDeclaration(SymbolId n, ASTNode* exp, const TinyType* t, bool ptr, u32 s) : ASTNode(t), name(n), expression(exp), pointer(ptr), slot(s) {}
+		SymbolId name;
+		ASTNode* expression;
 		bool pointer;
+		u32 slot;
 
 		NodeType node_type() override
 		{
 			return NodeType::VarDeclaration;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 	struct RetDeclaration : ASTNode
 	{
-		RetDeclaration(std::unique_ptr<ASTNode> exp) : ASTNode(std::make_unique<TinyType>(exp->type->type)), expression(std::move(exp)) {}
-		std::unique_ptr<ASTNode> expression;
+		RetDeclaration(ASTNode* exp) : ASTNode(exp->type), expression(exp) {}
+		ASTNode* expression;
 
 		NodeType node_type() override
 		{
 			return NodeType::RetDeclaration;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 	struct BinaryOperator : ASTNode
 	{
-		BinaryOperator(TokenType o, std::unique_ptr<ASTNode> l, std::unique_ptr<ASTNode> r) : ASTNode(std::make_unique<TinyType>(l->type->type)), op(o), left(std::move(l)), right(std::move(r)) {}
+		BinaryOperator(TokenType o, ASTNode* l, ASTNode* r) : ASTNode(l->type), op(o), left(l), right(r) {}
 		TokenType op;
-		std::unique_ptr<ASTNode> left;
-		std::unique_ptr<ASTNode> right;
+		ASTNode* left;
+		ASTNode* right;
 
 		NodeType node_type() override
 		{
 			return NodeType::BinaryOperator;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 	struct Identifier : ASTNode
 	{
-		Identifier(const std::string& n, std::unique_ptr<TinyType> t) : ASTNode(std::move(t)), name(n) {}
+		Identifier(SymbolId n, const TinyType* t, u32 s) : ASTNode(t), name(n), slot(s) {}
 
-		std::string name;
+		SymbolId name;
+		// Local slot in the enclosing function
+		u32 slot;
 
 		NodeType node_type() override
 		{
 			return NodeType::Identifier;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 	struct IntLiteral : ASTNode
 	{
-		IntLiteral(i32 v) : ASTNode(std::make_unique<TinyType>(Type::I32)), value(v) {}
+		IntLiteral(const TinyType* t, i32 v) : ASTNode(t), value(v) {}
 
 		i32 value;
 
@@ -195,28 +162,19 @@ namespace tiny {
 		{
 			return NodeType::IntLiteral;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 	struct StringLiteral : ASTNode
 	{
-		StringLiteral(const std::string& v) : ASTNode(std::make_unique<TinyType>(Type::I8Ptr)), value(v) {}
+		// The value is copied into the AST's arena
+		StringLiteral(const TinyType* t, llvm::StringRef v) : ASTNode(t), value(v) {}
 
-		std::string value;
+		llvm::StringRef value;
 
 		NodeType node_type() override
 		{
 			return NodeType::StringLiteral;
 		}
-
-		std::unique_ptr<CodegenResult> codegen(CodeGen* visitor) override
-		{
-			return visitor->visit(this);
-		}
 	};
 
 }
@@ -0,0 +1,205 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "flat_ast.h"
+#include "fold.h"
+#include "parallel_codegen.h"
+#include "parser.h"
+#include "tiny_exception.h"
+
+namespace tiny {
+
+	// Every statement of a function adds this many nodes, v<i> := x + y * <i> - v<i - 1>
+	static const u32 nodes_per_statement = 8;
+	static const u32 ast_statements_per_function = 50;
+	// Roughly the size of a small hand written function, so the backend dominates like it does for real programs
+	static const u32 codegen_statements_per_function = 10;
+	// Each timing is the best of this many runs
+	static const u32 repeats = 10;
+
+	// Every function but the first calls the one before it, so the partitions of compile_parallel link to each other
+	static std::string generate_program(u32 functions, u32 statements)
+	{
+		std::string source;
+		for (u32 f = 0; f < functions; f++)
+		{
+			source += "fn f" + std::to_string(f) + "(x i32, y i32) -> i32 {\n\tv0 := x + y\n";
+			for (u32 s = 1; s < statements; s++)
+				source += "\tv" + std::to_string(s) + " := x + y * " + std::to_string(s) + " - v" + std::to_string(s - 1) + "\n";
+
+			auto result = "v" + std::to_string(statements - 1);
+			if (f == 0)
+				source += "\tret " + result + "\n}\n\n";
+			else
+				source += "\tret " + result + " + f" + std::to_string(f - 1) + "(y, x)\n}\n\n";
+		}
+
+		return source + "fn main() -> i32 {\n\tret f0(1, 2)\n}\n";
+	}
+
+	static std::unique_ptr<AST> parse(const std::string& source, Interner* interner)
+	{
+		Parser parser(std::make_unique<Lexer>(llvm::MemoryBuffer::getMemBufferCopy(source, "bench.tiny"), interner));
+		return parser.parse();
+	}
+
+	struct TraversalResult
+	{
+		u64 nodes;
+		u64 literal_sum;
+	};
+
+	static void visit(ASTNode* node, TraversalResult& result)
+	{
+		result.nodes++;
+
+		switch (node->node_type())
+		{
+		case NodeType::FnDeclaration: {
+			auto fn = static_cast<FnDeclaration*>(node);
+			for (auto arg : fn->args)
+				visit(arg, result);
+			for (auto statement : fn->body)
+				visit(statement, result);
+			break;
+		}
+		case NodeType::VarDeclaration:
+			visit(static_cast<VarDeclaration*>(node)->expression, result);
+			break;
+		case NodeType::BinaryOperator:
+			visit(static_cast<BinaryOperator*>(node)->left, result);
+			visit(static_cast<BinaryOperator*>(node)->right, result);
+			break;
+		case NodeType::RetDeclaration:
+			visit(static_cast<RetDeclaration*>(node)->expression, result);
+			break;
+		case NodeType::CallExp:
+			for (auto arg : static_cast<CallExp*>(node)->args)
+				visit(arg, result);
+			break;
+		case NodeType::IntLiteral:
+			result.literal_sum += static_cast<IntLiteral*>(node)->value;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Runs traversal repeats times and prints the fastest run, every run has to produce the same result
+	template<class TTraversal>
+	static TraversalResult measure(const char* name, TTraversal&& traversal)
+	{
+		auto best = std::chrono::duration<double, std::milli>::max();
+		TraversalResult result;
+
+		for (u32 i = 0; i < repeats; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			result = traversal();
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start));
+		}
+
+		llvm::outs() << "bench: " << name << " " << llvm::format("%.2f", best.count()) << " ms, " << llvm::format("%.2f", best.count() * 1e6 / result.nodes) << " ns per node\n";
+		return result;
+	}
+
+	void run_ast_benchmark(u32 node_count)
+	{
+		auto functions = std::max(1u, node_count / (nodes_per_statement * ast_statements_per_function));
+		auto source = generate_program(functions, ast_statements_per_function);
+
+		// Lexed on its own first, with an interner of its own so it does not find the names already interned
+		auto lex_start = std::chrono::high_resolution_clock::now();
+		{
+			Interner interner;
+			Lexer lexer(llvm::MemoryBuffer::getMemBufferCopy(source, "bench.tiny"), &interner);
+			lexer.tokenize();
+		}
+		auto lexed = std::chrono::high_resolution_clock::now();
+
+		Interner interner;
+		auto start = std::chrono::high_resolution_clock::now();
+		auto ast = parse(source, &interner);
+		auto parsed = std::chrono::high_resolution_clock::now();
+		auto flat = flatten(ast.get());
+		auto flattened = std::chrono::high_resolution_clock::now();
+
+		llvm::outs() << "bench: " << flat.nodes.size() << " nodes from " << source.size() << " bytes, lexed in " << llvm::format("%.2f", std::chrono::duration<double, std::milli>(lexed - lex_start).count())
+			<< " ms, lexed and parsed in " << llvm::format("%.2f", std::chrono::duration<double, std::milli>(parsed - start).count()) << " ms, flattened in "
+			<< llvm::format("%.2f", std::chrono::duration<double, std::milli>(flattened - parsed).count()) << " ms\n";
+
+		auto tree = measure("pointer tree", [&]() {
+			TraversalResult result = {};
+			for (auto node : ast->nodes)
+				visit(node, result);
+			return result;
+		});
+
+		auto walked = measure("flat walk", [&]() {
+			TraversalResult result = {};
+			for (auto root : flat.roots)
+			{
+				walk(flat, root, [&](NodeIndex, const FlatNode& node) {
+					result.nodes++;
+					if (node.kind == NodeType::IntLiteral)
+						result.literal_sum += static_cast<i32>(node.data);
+				});
+			}
+			return result;
+		});
+
+		// Passes that do not care about the order just loop over the array
+		auto scanned = measure("flat scan", [&]() {
+			TraversalResult result = {};
+			for (auto& node : flat.nodes)
+			{
+				result.nodes++;
+				if (node.kind == NodeType::IntLiteral)
+					result.literal_sum += static_cast<i32>(node.data);
+			}
+			return result;
+		});
+
+		if (tree.nodes != walked.nodes || tree.nodes != scanned.nodes || tree.literal_sum != walked.literal_sum || tree.literal_sum != scanned.literal_sum)
+			throw TinyException("The traversals of the pointer tree and the FlatAST visited different nodes");
+	}
+
+
+	void run_codegen_benchmark(u32 function_count, OptLevel level, u32 max_threads)
+	{
+		Interner interner;
+		auto ast = parse(generate_program(function_count, codegen_statements_per_function), &interner);
+		fold_constants(ast.get());
+
+		llvm::outs() << "bench: " << ast->function_count << " functions at O" << static_cast<u32>(level) << ", " << std::thread::hardware_concurrency() << " hardware threads\n";
+
+		double single_thread = 0;
+		for (u32 threads = 1; ; threads = std::min(threads * 2, max_threads))
+		{
+			// CPU time of the whole process, compared to the wall time it shows how much work the split adds
+			auto cpu_start = std::clock();
+			auto start = std::chrono::high_resolution_clock::now();
+			auto objects = compile_parallel(ast.get(), level, threads);
+			auto wall = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			auto cpu = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+			if (threads == 1)
+				single_thread = wall;
+
+			llvm::outs() << "bench: " << threads << " threads, " << objects.size() << " objects, " << llvm::format("%.0f", wall) << " ms wall, " << llvm::format("%.0f", cpu)
+				<< " ms cpu, speedup " << llvm::format("%.2f", single_thread / wall) << "\n";
+
+			if (threads == max_threads)
+				break;
+		}
+	}
+
+}
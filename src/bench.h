@@ -0,0 +1,15 @@
+#pragma once
+
+#include "codegen.h"
+
+namespace tiny {
+
+	// Parses a generated program of about node_count nodes and prints how long a recursive walk over the pointer
+	// tree takes compared to walk() and a linear loop over the FlatAST built from it
+	void run_ast_benchmark(u32 node_count);
+
+	// Generates a program with function_count functions and times compile_parallel on it with 1, 2, 4, ... up to
+	// max_threads threads
+	void run_codegen_benchmark(u32 function_count, OptLevel level, u32 max_threads);
+
+}
@@ -1,223 +1,302 @@
 #include "codegen.h"
 
 #include "ast.h"
+#include "flat_ast.h"
+#include "signature.h"
 #include "tiny_exception.h"
 
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Scalar.h"
 
 namespace tiny {
 
-	CodeGen::CodeGen(llvm::TargetMachine* tm) : module_(std::make_unique<llvm::Module>("tiny", llvm::getGlobalContext())), builder_(llvm::getGlobalContext())
+	CodeGen::CodeGen(llvm::LLVMContext& context, llvm::TargetMachine* tm, OptLevel level) : context_(context), ast_(nullptr), interner_(nullptr), module_(std::make_unique<llvm::Module>("tiny", context)), builder_(context), tm_(tm), level_(level), partition_(0), partition_count_(1), batch_functions_(false)
 	{
 		module_->setDataLayout(tm->createDataLayout());
+		module_->setTargetTriple(tm->getTargetTriple().str());
+
+		create_function_passes();
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(AST* ast)
+	llvm::Value* CodeGen::generate(NodeIndex index)
 	{
-		for (auto& node : ast->nodes)
+		const auto& node = ast_->nodes[index];
+
+		switch (node.kind)
 		{
-			auto r = node->codegen(this);
+		case NodeType::FnDeclaration:
+			generate_function(ast_->fns[node.data]);
+			return nullptr;
+		case NodeType::ArgDeclaration:
+			return nullptr;
+		case NodeType::VarDeclaration: {
+			const auto& var = ast_->vars[node.data];
+			auto f = builder_.GetInsertBlock()->getParent();
+			auto value = generate(var.expression);
+			auto alloca = create_alloca(f, get_llvm_type(node.type));
+
+			locals_[var.slot] = LLVMSymbol(alloca, node.type);
+
+			return builder_.CreateStore(value, alloca);
+		}
+		case NodeType::IntLiteral:
+			return builder_.getInt32(node.data);
+		case NodeType::StringLiteral:
+			return builder_.CreateGlobalStringPtr(ast_->strings[node.data]);
+		case NodeType::BinaryOperator: {
+			const auto& binary = ast_->binaries[node.data];
+			auto l = generate(binary.left);
+			auto r = generate(binary.right);
+
+			switch (binary.op)
+			{
+			case TokenType::Plus:
+				return builder_.CreateAdd(l, r);
+			case TokenType::Minus:
+				return builder_.CreateSub(l, r);
+			case TokenType::Star:
+				return builder_.CreateMul(l, r);
+			case TokenType::Divide:
+				return builder_.CreateSDiv(l, r);
+			default:
+				throw TinyException("CodeGen::generate -> BinaryOperator -> default");
+			}
 		}
+		case NodeType::Identifier:
+			return builder_.CreateLoad(locals_[node.data].value);
+		case NodeType::RetDeclaration:
+			builder_.CreateRet(generate(node.data));
+			return nullptr;
+		case NodeType::CallExp: {
+			const auto& call = ast_->calls[node.data];
 
-		return nullptr;
+			std::vector<llvm::Value*> args;
+			for (auto arg : ast_->get_children(call.first_arg, call.arg_count))
+				args.push_back(generate(arg));
+
+			return builder_.CreateCall(functions_[call.function], args);
+		}
+		default:
+			throw TinyException("CodeGen::generate -> default case");
+		}
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(FnDeclaration* node)
+	void CodeGen::generate_function(const FlatFn& fn)
 	{
+		auto arg_nodes = ast_->get_children(fn.first_arg, fn.arg_count);
+
 		std::vector<llvm::Type*> args;
+		for (auto arg : arg_nodes)
+			args.push_back(get_llvm_type(ast_->nodes[arg].type));
 
-		for (auto& arg : node->args)
-		{
-			args.push_back(get_llvm_type(arg->type.get()));
-		}
+		auto ft = llvm::FunctionType::get(get_llvm_type(fn.return_type), args, false);
+		auto f = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, interner_->get(fn.name), module_.get());
+		functions_[fn.index] = f;
 
-		auto ft = llvm::FunctionType::get(get_llvm_type(node->return_type.get()), args, false);
-		auto f = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, node->name, module_.get());
+		if (fn.external || fn.index % partition_count_ != partition_)
+			return;
 
-		if (node->external)
-		{
-			return nullptr;
-		}
-		
-		push_scope(std::make_unique<SymbolTable<LLVMSymbol>>(nullptr));
-		
-		auto bb = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entryblock", f);
+		locals_.assign(fn.local_count, LLVMSymbol(nullptr, nullptr));
+
+		auto bb = llvm::BasicBlock::Create(context_, "entryblock", f);
 		builder_.SetInsertPoint(bb);
 
+		// Values stay unnamed, LLVM would hash and unique every name in the function's symbol table
 		auto i = 0;
 		for (auto& arg : f->args())
 		{
-			// Set the argument name to get a little bit more readable IR
-			arg.setName(node->args[i++]->name);
+			const auto& declaration = ast_->nodes[arg_nodes[i++]];
 
-			auto alloca = create_alloca(f, arg.getName(), arg.getType());
-			auto inst = builder_.CreateStore(&arg, alloca);
-			current_scope()->add_entry(arg.getName(), std::make_unique<LLVMSymbol>(alloca, get_type(arg.getType())));
-		}
-		
-		for (auto& n : node->body)
-		{
-			auto r = n->codegen(this);
+			auto alloca = create_alloca(f, arg.getType());
+			builder_.CreateStore(&arg, alloca);
+			locals_[declaration.data] = LLVMSymbol(alloca, declaration.type);
 		}
 
-		llvm::verifyFunction(*f);
+		for (auto statement : ast_->get_children(fn.first_statement, fn.statement_count))
+			generate(statement);
 
-		pop_scope();
+		verify_function(f);
 
-		return nullptr;
-	}
+		if (function_passes_)
+			function_passes_->run(*f);
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(ArgDeclaration* node)
-	{
-		return nullptr;
+		if (batch_functions_)
+			emit_batch_function(fn, f);
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(VarDeclaration* node)
+	std::unique_ptr<llvm::Module> CodeGen::execute(const FlatAST& ast, u32 partition, u32 partition_count)
 	{
-		auto f = builder_.GetInsertBlock()->getParent();
-		auto exp_result = node->expression->codegen(this);
-		auto alloca = create_alloca(f, node->name, get_llvm_type(node->type.get()));
+		ast_ = &ast;
+		interner_ = ast.interner;
+		partition_ = partition;
+		partition_count_ = partition_count;
+		functions_.assign(ast.function_count, nullptr);
 
-		current_scope()->add_entry(node->name, std::make_unique<LLVMSymbol>(alloca, node->type->type));
+		for (auto root : ast.roots)
+			generate(root);
 
-		return create_codegen_result(builder_.CreateStore(exp_result->value, alloca));
+		run_module_passes();
+		return std::move(module_);
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(BinaryOperator* node)
+	std::unique_ptr<llvm::Module> CodeGen::execute(const AST* ast, u32 partition, u32 partition_count)
 	{
-		auto l = node->left->codegen(this);
-		auto r = node->right->codegen(this);
-
-		switch (node->op)
-		{
-		case TokenType::Plus: 
-			return create_codegen_result(builder_.CreateAdd(l->value, r->value, "addtmp"));
-			break;
-		case TokenType::Minus: 
-			return create_codegen_result(builder_.CreateSub(l->value, r->value, "subtmp"));
-			break;
-		case TokenType::Star:
-			return create_codegen_result(builder_.CreateMul(l->value, r->value, "multmp"));
-			break;
-		case TokenType::Divide: 
-			return create_codegen_result(builder_.CreateSDiv(l->value, r->value, "divtmp"));
-			break;
-		default: 
-			throw TinyException("CodeGen::visit -> BinaryOperator -> default");
-		}
+		auto flat = flatten(ast);
+		return execute(flat, partition, partition_count);
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(Identifier* node)
+	llvm::AllocaInst* CodeGen::create_alloca(llvm::Function* function, llvm::Type* type)
 	{
-		auto entry = current_scope()->get_entry(node->name);
-		return create_codegen_result(builder_.CreateLoad(entry->value->value, node->name));
+		auto b = llvm::IRBuilder<>(&function->getEntryBlock(), function->getEntryBlock().begin());
+		return b.CreateAlloca(type);
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(IntLiteral* node)
+	llvm::Type* CodeGen::get_llvm_type(const TinyType* type) const
 	{
-		return create_codegen_result(llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(32, node->value, true)));
+		switch (type->type)
+		{
+		case Type::I32: 
+			return llvm::Type::getInt32Ty(context_);
+		case Type::I32Ptr:
+			return llvm::Type::getInt32PtrTy(context_);
+		case Type::I8:
+			return llvm::Type::getInt8Ty(context_);
+		case Type::I8Ptr:
+			return llvm::Type::getInt8PtrTy(context_);
+		default: 
+			throw TinyException("Default case --> CodeGen::get_llvm_type");
+		}
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(StringLiteral* node)
+	void CodeGen::set_batch_functions(bool enabled)
 	{
-		return create_codegen_result(builder_.CreateGlobalStringPtr(node->value));
+		batch_functions_ = enabled;
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(RetDeclaration* node)
+	void CodeGen::emit_batch_function(const FlatFn& fn, llvm::Function* callee)
 	{
-		auto r = node->expression->codegen(this);
-		builder_.CreateRet(r->value);
-		return nullptr;
-	}
+		if (!is_scalar(fn.return_type))
+			return;
 
-	std::unique_ptr<CodegenResult> CodeGen::visit(CallExp* node)
-	{
-		auto callee = get_function(node->name);
-		
-		std::vector<llvm::Value*> args;
-		for (auto& arg : node->args)
+		// void name.batch(i32 count, T0* a0, ..., R* out)
+		std::vector<llvm::Type*> params;
+		params.push_back(builder_.getInt32Ty());
+		for (auto arg : ast_->get_children(fn.first_arg, fn.arg_count))
 		{
-			auto arg_result = arg->codegen(this);
-			args.push_back(arg_result->value);
+			auto type = ast_->nodes[arg].type;
+			if (!is_scalar(type))
+				return;
+
+			params.push_back(get_llvm_type(type)->getPointerTo());
 		}
-		
-		return create_codegen_result(builder_.CreateCall(callee, args, "calltmp"));
-	}
+		params.push_back(get_llvm_type(fn.return_type)->getPointerTo());
 
-	std::unique_ptr<llvm::Module> CodeGen::execute(AST* ast)
-	{
-		visit(ast);
-		return std::move(module_);
-	}
+		auto ft = llvm::FunctionType::get(builder_.getVoidTy(), params, false);
+		auto f = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, get_batch_function_name(interner_->get(fn.name).str()), module_.get());
 
-	llvm::AllocaInst* CodeGen::create_alloca(llvm::Function* function, const std::string& name, llvm::Type* type)
-	{
-		auto b = llvm::IRBuilder<>(&function->getEntryBlock(), function->getEntryBlock().begin());
-		return b.CreateAlloca(type, nullptr, name);
-	}
+		// Lets the vectorizer skip the runtime overlap checks, BatchSignature documents this for callers
+		for (u32 i = 2; i <= params.size(); i++)
+			f->setDoesNotAlias(i);
 
-	llvm::Function* CodeGen::get_function(const std::string& name) const
-	{
-		return module_->getFunction(name);
-	}
+		auto entry = llvm::BasicBlock::Create(context_, "entry", f);
+		auto loop = llvm::BasicBlock::Create(context_, "loop", f);
+		auto exit = llvm::BasicBlock::Create(context_, "exit", f);
 
-	void CodeGen::push_scope(std::unique_ptr<SymbolTable<LLVMSymbol>> scope)
-	{
-		scopes_.push(std::move(scope));
-	}
+		std::vector<llvm::Value*> arrays;
+		for (auto& arg : f->args())
+			arrays.push_back(&arg);
 
-	void CodeGen::pop_scope()
-	{
-		scopes_.pop();
+		auto count = arrays.front();
+		auto out = arrays.back();
+
+		builder_.SetInsertPoint(entry);
+		builder_.CreateCondBr(builder_.CreateICmpSGT(count, builder_.getInt32(0)), loop, exit);
+
+		builder_.SetInsertPoint(loop);
+		auto i = builder_.CreatePHI(builder_.getInt32Ty(), 2);
+		i->addIncoming(builder_.getInt32(0), entry);
+
+		std::vector<llvm::Value*> args;
+		for (size_t a = 1; a + 1 < arrays.size(); a++)
+			args.push_back(builder_.CreateLoad(builder_.CreateGEP(arrays[a], i)));
+
+		builder_.CreateStore(builder_.CreateCall(callee, args), builder_.CreateGEP(out, i));
+
+		auto next = builder_.CreateNSWAdd(i, builder_.getInt32(1));
+		i->addIncoming(next, loop);
+		builder_.CreateCondBr(builder_.CreateICmpSLT(next, count), loop, exit);
+
+		builder_.SetInsertPoint(exit);
+		builder_.CreateRetVoid();
+
+		verify_function(f);
+
+		if (function_passes_)
+			function_passes_->run(*f);
 	}
 
-	SymbolTable<LLVMSymbol>* CodeGen::current_scope()
+	// The function passes assume valid IR, so nothing may run on a function before it passed this
+	void CodeGen::verify_function(llvm::Function* f)
 	{
-		return scopes_.top().get();
+		if (llvm::verifyFunction(*f, &llvm::errs()))
+			throw TinyException("Invalid code generated for the function '" + f->getName().str() + "', does every path end in a return?");
 	}
 
-	std::unique_ptr<CodegenResult> CodeGen::create_codegen_result(llvm::Value* v) const
+	bool CodeGen::is_scalar(const TinyType* type)
 	{
-		return std::make_unique<CodegenResult>(v);
+		return type->type == Type::I32 || type->type == Type::I8;
 	}
 
-	llvm::Type* CodeGen::get_llvm_type(const TinyType* type)
+	void CodeGen::create_function_passes()
 	{
-		switch (type->type)
+		if (level_ == OptLevel::O0)
+			return;
+
+		function_passes_ = std::make_unique<llvm::legacy::FunctionPassManager>(module_.get());
+		function_passes_->add(llvm::createTargetTransformInfoWrapperPass(tm_->getTargetIRAnalysis()));
+
+		// Every local starts out as an alloca, promoting them to registers is what makes the other passes useful
+		function_passes_->add(llvm::createPromoteMemoryToRegisterPass());
+		function_passes_->add(llvm::createInstructionCombiningPass());
+
+		if (level_ >= OptLevel::O2)
 		{
-		case Type::I32: 
-			return llvm::Type::getInt32Ty(llvm::getGlobalContext());
-		case Type::I32Ptr:
-			return llvm::Type::getInt32PtrTy(llvm::getGlobalContext());
-		case Type::I8:
-			return llvm::Type::getInt8Ty(llvm::getGlobalContext());
-		case Type::I8Ptr:
-			return llvm::Type::getInt8PtrTy(llvm::getGlobalContext());
-		default: 
-			throw TinyException("Default case --> CodeGen::get_llvm_type");
+			function_passes_->add(llvm::createReassociatePass());
+			function_passes_->add(llvm::createGVNPass());
 		}
+
+		function_passes_->add(llvm::createCFGSimplificationPass());
+		function_passes_->doInitialization();
 	}
 
-	std::unique_ptr<TinyType> CodeGen::get_type(const llvm::Type* type)
+	void CodeGen::run_module_passes()
 	{
-		if(type->isIntegerTy(32))
-		{
-			if (type->isPointerTy())
-				return std::make_unique<TinyType>(Type::I32Ptr);
+		if (function_passes_)
+			function_passes_->doFinalization();
 
-			return std::make_unique<TinyType>(Type::I32);
-		}
+		if (level_ == OptLevel::O0)
+			return;
 
-		if (type->isIntegerTy(8))
-		{
-			if (type->isPointerTy())
-				return std::make_unique<TinyType>(Type::I8Ptr);
+		llvm::PassManagerBuilder builder;
+		builder.OptLevel = static_cast<unsigned>(level_);
+		builder.SizeLevel = 0;
 
-			return std::make_unique<TinyType>(Type::I8);
-		}
+		if (level_ >= OptLevel::O2)
+			builder.Inliner = llvm::createFunctionInliningPass(builder.OptLevel, builder.SizeLevel);
 
-		throw TinyException("Default case --> CodeGen::get_type");
+		builder.LoopVectorize = level_ == OptLevel::O3;
+		builder.SLPVectorize = level_ == OptLevel::O3;
+
+		llvm::legacy::PassManager passes;
+		passes.add(llvm::createTargetTransformInfoWrapperPass(tm_->getTargetIRAnalysis()));
+		builder.populateModulePassManager(passes);
+		passes.run(*module_);
 	}
+
 }
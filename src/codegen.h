@@ -1,75 +1,95 @@
 #pragma once
 
-#include <stack>
+#include <vector>
 
 #include "type.h"
-#include "symbols.h"
+#include "interner.h"
 
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
 
 namespace tiny {
 	
 	struct AST;
-	struct ASTNode;
-	struct FnDeclaration;
-	struct VarDeclaration;
-	struct BinaryOperator;
-	struct Identifier;
-	struct IntLiteral;
-	struct StringLiteral;
-	struct RetDeclaration;
-	struct CallExp;
-	struct ArgDeclaration;
-
-	struct CodegenResult
+	struct FlatAST;
+	struct FlatFn;
+
+	enum class OptLevel : u8
 	{
-		CodegenResult(llvm::Value* v) : value(v) {}
-		llvm::Value* value;
+		// No IR passes, fastest to compile
+		O0,
+		// mem2reg and cheap local cleanups
+		O1,
+		// Adds GVN and reassociation per function and the inliner on the module
+		O2,
+		// O2 with a more aggressive inliner and the vectorizers
+		O3,
 	};
 
+	// The backend level that goes with level, CodeGen leaves the TargetMachine alone so whoever creates it sets this
+	inline llvm::CodeGenOpt::Level get_codegen_opt_level(OptLevel level)
+	{
+		return level == OptLevel::O0 ? llvm::CodeGenOpt::None : static_cast<llvm::CodeGenOpt::Level>(level);
+	}
+
 	struct LLVMSymbol
 	{
-		LLVMSymbol(llvm::AllocaInst* v, Type t) : value(v), type(std::make_unique<TinyType>(t)) {}
-		LLVMSymbol(llvm::AllocaInst* v, std::unique_ptr<TinyType> t) : value(v), type(std::move(t)) {}
+		LLVMSymbol(llvm::AllocaInst* v, const TinyType* t) : value(v), type(t) {}
 		llvm::AllocaInst * value;
-		std::unique_ptr<TinyType> type;
+		const TinyType* type;
 	};
 
 	class CodeGen
 	{
 	public:
-		CodeGen(llvm::TargetMachine* tm);
+		// Everything is created in context, which has to outlive the module returned by execute
+		CodeGen(llvm::LLVMContext& context, llvm::TargetMachine* tm, OptLevel level = OptLevel::O0);
 
-		std::unique_ptr<CodegenResult> visit(AST* ast);
-		std::unique_ptr<CodegenResult> visit(FnDeclaration* node);
-		std::unique_ptr<CodegenResult> visit(ArgDeclaration* node);
-		std::unique_ptr<CodegenResult> visit(VarDeclaration* node);
-		std::unique_ptr<CodegenResult> visit(BinaryOperator* node);
-		std::unique_ptr<CodegenResult> visit(Identifier* node);
-		std::unique_ptr<CodegenResult> visit(IntLiteral* node);
-		std::unique_ptr<CodegenResult> visit(StringLiteral* node);
-		std::unique_ptr<CodegenResult> visit(RetDeclaration* node);
-		std::unique_ptr<CodegenResult> visit(CallExp* node);
+		// Only the bodies of functions whose index % partition_count is partition are emitted, the others are declared
+		std::unique_ptr<llvm::Module> execute(const FlatAST& ast, u32 partition = 0, u32 partition_count = 1);
+		// Flattens ast first, callers generating several partitions should flatten once themselves
+		std::unique_ptr<llvm::Module> execute(const AST* ast, u32 partition = 0, u32 partition_count = 1);
 
-		std::unique_ptr<llvm::Module> execute(AST* ast);
+		// Also emit a batch wrapper (see get_batch_function_name) for every function that only takes and returns
+		// scalars. The callee is inlined from O2 on and the loop is vectorized at O3.
+		void set_batch_functions(bool enabled);
 
 	private:
-		static llvm::AllocaInst* create_alloca(llvm::Function* function, const std::string& name, llvm::Type* type);
-		llvm::Function* get_function(const std::string& name) const;
+		// Dispatches on the node's kind, returns the value of expressions and nullptr for everything else
+		llvm::Value* generate(u32 index);
+		void generate_function(const FlatFn& fn);
+
+		static llvm::AllocaInst* create_alloca(llvm::Function* function, llvm::Type* type);
 
-		void push_scope(std::unique_ptr<SymbolTable<LLVMSymbol>> scope);
-		void pop_scope();
-		SymbolTable<LLVMSymbol>* current_scope();
+		llvm::Type* get_llvm_type(const TinyType* type) const;
 
-		std::unique_ptr<CodegenResult> create_codegen_result(llvm::Value* v) const;
+		void emit_batch_function(const FlatFn& fn, llvm::Function* callee);
+		void verify_function(llvm::Function* f);
+		static bool is_scalar(const TinyType* type);
 
-		static llvm::Type* get_llvm_type(const TinyType* type);
-		static std::unique_ptr<TinyType> get_type(const llvm::Type* type);
+		void create_function_passes();
+		void run_module_passes();
 
+		llvm::LLVMContext& context_;
+		// The AST execute is working on
+		const FlatAST* ast_;
+		Interner* interner_;
 		std::unique_ptr<llvm::Module> module_;
 		llvm::IRBuilder<> builder_;
-		std::stack<std::unique_ptr<SymbolTable<LLVMSymbol>>> scopes_;
+		llvm::TargetMachine* tm_;
+		OptLevel level_;
+		u32 partition_;
+		u32 partition_count_;
+		bool batch_functions_;
+		// Runs on every function after it is verified, nullptr at O0
+		std::unique_ptr<llvm::legacy::FunctionPassManager> function_passes_;
+		// Indexed by FnDeclaration::index
+		std::vector<llvm::Function*> functions_;
+		// Local slots of the function being generated
+		std::vector<LLVMSymbol> locals_;
 	};
 
 }
\ No newline at end of file
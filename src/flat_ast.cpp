@@ -0,0 +1,100 @@
+#include "flat_ast.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+#include "tiny_exception.h"
+
+namespace tiny {
+
+	static NodeIndex flatten(FlatAST& flat, ASTNode* node);
+
+	template<class TNode>
+	static u32 flatten_range(FlatAST& flat, llvm::ArrayRef<TNode*> nodes)
+	{
+		// Children are flattened first since that appends to children as well, the range is only added afterwards
+		llvm::SmallVector<NodeIndex, 16> indices;
+		for (auto n : nodes)
+			indices.push_back(flatten(flat, n));
+
+		auto first = static_cast<u32>(flat.children.size());
+		flat.children.insert(flat.children.end(), indices.begin(), indices.end());
+		return first;
+	}
+
+	static NodeIndex add_node(FlatAST& flat, ASTNode* node, u32 data)
+	{
+		flat.nodes.push_back(FlatNode{ node->node_type(), node->type, data });
+		return static_cast<NodeIndex>(flat.nodes.size() - 1);
+	}
+
+	static NodeIndex flatten(FlatAST& flat, ASTNode* node)
+	{
+		switch (node->node_type())
+		{
+		case NodeType::FnDeclaration: {
+			auto fn = static_cast<FnDeclaration*>(node);
+			FlatFn flat_fn;
+			flat_fn.name = fn->name;
+			flat_fn.return_type = fn->return_type;
+			flat_fn.external = fn->external;
+			flat_fn.index = fn->index;
+			flat_fn.local_count = fn->local_count;
+			flat_fn.first_arg = flatten_range<ArgDeclaration>(flat, fn->args);
+			flat_fn.arg_count = static_cast<u32>(fn->args.size());
+			flat_fn.first_statement = flatten_range<ASTNode>(flat, fn->body);
+			flat_fn.statement_count = static_cast<u32>(fn->body.size());
+
+			flat.fns.push_back(flat_fn);
+			return add_node(flat, node, static_cast<u32>(flat.fns.size() - 1));
+		}
+		case NodeType::ArgDeclaration:
+			return add_node(flat, node, static_cast<ArgDeclaration*>(node)->slot);
+		case NodeType::VarDeclaration: {
+			auto var = static_cast<VarDeclaration*>(node);
+			auto expression = flatten(flat, var->expression);
+
+			flat.vars.push_back(FlatVar{ expression, var->slot, var->pointer });
+			return add_node(flat, node, static_cast<u32>(flat.vars.size() - 1));
+		}
+		case NodeType::IntLiteral:
+			return add_node(flat, node, static_cast<u32>(static_cast<IntLiteral*>(node)->value));
+		case NodeType::StringLiteral:
+			flat.strings.push_back(static_cast<StringLiteral*>(node)->value);
+			return add_node(flat, node, static_cast<u32>(flat.strings.size() - 1));
+		case NodeType::BinaryOperator: {
+			auto op = static_cast<BinaryOperator*>(node);
+			auto left = flatten(flat, op->left);
+			auto right = flatten(flat, op->right);
+
+			flat.binaries.push_back(FlatBinary{ op->op, left, right });
+			return add_node(flat, node, static_cast<u32>(flat.binaries.size() - 1));
+		}
+		case NodeType::Identifier:
+			return add_node(flat, node, static_cast<Identifier*>(node)->slot);
+		case NodeType::RetDeclaration:
+			return add_node(flat, node, flatten(flat, static_cast<RetDeclaration*>(node)->expression));
+		case NodeType::CallExp: {
+			auto call = static_cast<CallExp*>(node);
+			auto first_arg = flatten_range<ASTNode>(flat, call->args);
+
+			flat.calls.push_back(FlatCall{ call->function, first_arg, static_cast<u32>(call->args.size()) });
+			return add_node(flat, node, static_cast<u32>(flat.calls.size() - 1));
+		}
+		default:
+			throw TinyException("flatten -> default case");
+		}
+	}
+
+	FlatAST flatten(const AST* ast)
+	{
+		FlatAST flat;
+		flat.function_count = ast->function_count;
+		flat.interner = ast->interner;
+
+		for (auto node : ast->nodes)
+			flat.roots.push_back(flatten(flat, node));
+
+		return flat;
+	}
+
+}
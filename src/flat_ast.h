@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "ast.h"
+
+namespace tiny {
+
+	typedef u32 NodeIndex;
+
+	// Common part of every node, data is either the payload itself or an index into the array for the node's kind:
+	//   FnDeclaration  -> FlatAST::fns
+	//   ArgDeclaration -> local slot of the argument
+	//   VarDeclaration -> FlatAST::vars
+	//   IntLiteral     -> the value
+	//   StringLiteral  -> FlatAST::strings
+	//   BinaryOperator -> FlatAST::binaries
+	//   Identifier     -> local slot it refers to
+	//   RetDeclaration -> NodeIndex of the expression
+	//   CallExp        -> FlatAST::calls
+	struct FlatNode
+	{
+		NodeType kind;
+		const TinyType* type;
+		u32 data;
+	};
+
+	// first/count pairs are ranges in FlatAST::children
+	struct FlatFn
+	{
+		SymbolId name;
+		const TinyType* return_type;
+		bool external;
+		// Same as FnDeclaration::index and local_count
+		u32 index;
+		u32 local_count;
+		u32 first_arg;
+		u32 arg_count;
+		u32 first_statement;
+		u32 statement_count;
+	};
+
+	struct FlatVar
+	{
+		NodeIndex expression;
+		u32 slot;
+		bool pointer;
+	};
+
+	struct FlatBinary
+	{
+		TokenType op;
+		NodeIndex left;
+		NodeIndex right;
+	};
+
+	struct FlatCall
+	{
+		// FnDeclaration::index of the callee
+		u32 function;
+		u32 first_arg;
+		u32 arg_count;
+	};
+
+	// Index based copy of an AST, what CodeGen works on. Every node is stored after all of its children so passes
+	// that only need a bottom-up order can run as one linear loop over nodes. Types and strings still point into the
+	// source AST, which has to outlive the copy.
+	struct FlatAST
+	{
+		std::vector<FlatNode> nodes;
+		std::vector<FlatFn> fns;
+		std::vector<FlatVar> vars;
+		std::vector<FlatBinary> binaries;
+		std::vector<FlatCall> calls;
+		std::vector<llvm::StringRef> strings;
+		std::vector<NodeIndex> children;
+		// The global declarations in source order
+		std::vector<NodeIndex> roots;
+		// Every FlatFn::index is below this
+		u32 function_count;
+		Interner* interner;
+
+		llvm::ArrayRef<NodeIndex> get_children(u32 first, u32 count) const
+		{
+			return llvm::ArrayRef<NodeIndex>(children.data() + first, count);
+		}
+	};
+
+	FlatAST flatten(const AST* ast);
+
+	// Calls visitor(index, node) for root and everything below it in pre-order, without recursion
+	template<class TVisitor>
+	void walk(const FlatAST& ast, NodeIndex root, TVisitor&& visitor)
+	{
+		std::vector<NodeIndex> stack;
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			auto index = stack.back();
+			stack.pop_back();
+
+			const auto& node = ast.nodes[index];
+			visitor(index, node);
+
+			// Children are pushed in reverse so they are visited in source order
+			switch (node.kind)
+			{
+			case NodeType::FnDeclaration: {
+				const auto& fn = ast.fns[node.data];
+				auto statements = ast.get_children(fn.first_statement, fn.statement_count);
+				for (auto it = statements.rbegin(); it != statements.rend(); ++it)
+					stack.push_back(*it);
+
+				auto args = ast.get_children(fn.first_arg, fn.arg_count);
+				for (auto it = args.rbegin(); it != args.rend(); ++it)
+					stack.push_back(*it);
+				break;
+			}
+			case NodeType::VarDeclaration:
+				stack.push_back(ast.vars[node.data].expression);
+				break;
+			case NodeType::BinaryOperator:
+				stack.push_back(ast.binaries[node.data].right);
+				stack.push_back(ast.binaries[node.data].left);
+				break;
+			case NodeType::RetDeclaration:
+				stack.push_back(node.data);
+				break;
+			case NodeType::CallExp: {
+				const auto& call = ast.calls[node.data];
+				auto args = ast.get_children(call.first_arg, call.arg_count);
+				for (auto it = args.rbegin(); it != args.rend(); ++it)
+					stack.push_back(*it);
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+
+}
@@ -0,0 +1,132 @@
+#include "fold.h"
+
+#include <limits>
+
+namespace tiny {
+
+	static ASTNode* fold(AST* ast, ASTNode* node);
+
+	static bool is_int_literal(ASTNode* node, i32 value)
+	{
+		return node->node_type() == NodeType::IntLiteral && static_cast<IntLiteral*>(node)->value == value;
+	}
+
+	// Evaluates l op r the way the generated IR would, add, sub and mul wrap around. Returns false for the divisions
+	// that are undefined in LLVM (by zero and INT_MIN / -1), those are left for the program to hit at runtime.
+	static bool evaluate(TokenType op, i32 l, i32 r, i32& result)
+	{
+		auto ul = static_cast<u32>(l);
+		auto ur = static_cast<u32>(r);
+
+		switch (op)
+		{
+		case TokenType::Plus:
+			result = static_cast<i32>(ul + ur);
+			return true;
+		case TokenType::Minus:
+			result = static_cast<i32>(ul - ur);
+			return true;
+		case TokenType::Star:
+			result = static_cast<i32>(ul * ur);
+			return true;
+		case TokenType::Divide:
+			if (r == 0 || (l == std::numeric_limits<i32>::min() && r == -1))
+				return false;
+
+			result = l / r;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static ASTNode* fold_binary_operator(AST* ast, BinaryOperator* node)
+	{
+		node->left = fold(ast, node->left);
+		node->right = fold(ast, node->right);
+
+		if (node->type->type != Type::I32)
+			return node;
+
+		auto l = node->left;
+		auto r = node->right;
+
+		if (l->node_type() == NodeType::IntLiteral && r->node_type() == NodeType::IntLiteral)
+		{
+			i32 result;
+			if (evaluate(node->op, static_cast<IntLiteral*>(l)->value, static_cast<IntLiteral*>(r)->value, result))
+				return ast->arena.create<IntLiteral>(node->type, result);
+
+			return node;
+		}
+
+		switch (node->op)
+		{
+		case TokenType::Plus:
+			if (is_int_literal(r, 0))
+				return l;
+			if (is_int_literal(l, 0))
+				return r;
+			break;
+		case TokenType::Minus:
+			if (is_int_literal(r, 0))
+				return l;
+			break;
+		case TokenType::Star:
+			if (is_int_literal(r, 1))
+				return l;
+			if (is_int_literal(l, 1))
+				return r;
+			break;
+		case TokenType::Divide:
+			if (is_int_literal(r, 1))
+				return l;
+			break;
+		default:
+			break;
+		}
+
+		return node;
+	}
+
+	// Returns the node that should take the place of node in its parent
+	static ASTNode* fold(AST* ast, ASTNode* node)
+	{
+		switch (node->node_type())
+		{
+		case NodeType::FnDeclaration: {
+			auto fn = static_cast<FnDeclaration*>(node);
+			for (auto& statement : fn->body)
+				statement = fold(ast, statement);
+			return fn;
+		}
+		case NodeType::VarDeclaration: {
+			auto var = static_cast<VarDeclaration*>(node);
+			var->expression = fold(ast, var->expression);
+			return var;
+		}
+		case NodeType::RetDeclaration: {
+			auto ret = static_cast<RetDeclaration*>(node);
+			ret->expression = fold(ast, ret->expression);
+			return ret;
+		}
+		case NodeType::CallExp: {
+			auto call = static_cast<CallExp*>(node);
+			for (auto& arg : call->args)
+				arg = fold(ast, arg);
+			return call;
+		}
+		case NodeType::BinaryOperator:
+			return fold_binary_operator(ast, static_cast<BinaryOperator*>(node));
+		default:
+			return node;
+		}
+	}
+
+	void fold_constants(AST* ast)
+	{
+		for (auto& node : ast->nodes)
+			node = fold(ast, node);
+	}
+
+}
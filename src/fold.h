@@ -0,0 +1,11 @@
+#pragma once
+
+#include "ast.h"
+
+namespace tiny {
+
+	// Replaces i32 arithmetic on literals with its result and removes operations with an identity operand (x + 0,
+	// x - 0, x * 1, 1 * x, x / 1). Runs in place, new literals are allocated in the AST's arena.
+	void fold_constants(AST* ast);
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+
+#include "type.h"
+
+namespace tiny {
+
+	typedef u32 SymbolId;
+
+	// Hands out a dense 32 bit id for every distinct identifier in a compilation,
+	// the Lexer fills it and every later stage compares and hashes ids instead of strings
+	class Interner
+	{
+	public:
+		SymbolId intern(llvm::StringRef name)
+		{
+			auto result = ids_.insert(std::make_pair(name, static_cast<SymbolId>(names_.size())));
+			if (result.second)
+				names_.push_back(result.first->getKey());
+
+			return result.first->getValue();
+		}
+
+		llvm::StringRef get(SymbolId id) const
+		{
+			return names_[id];
+		}
+
+		u32 size() const
+		{
+			return static_cast<u32>(names_.size());
+		}
+
+	private:
+		llvm::StringMap<SymbolId> ids_;
+		// Views of the keys owned by ids_, indexed by id
+		std::vector<llvm::StringRef> names_;
+	};
+
+}
@@ -1,38 +1,504 @@
 #pragma once
 
+#include <algorithm>
+#include <set>
+#include <unordered_set>
+#include <unordered_map>
+
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
 #include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
 #include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
-#include <llvm/ExecutionEngine/Orc/NullResolver.h>
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
 #include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/Orc/OrcArchitectureSupport.h>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
 #include <llvm/IR/Mangler.h>
+#include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "memory_manager.h"
+#include "signature.h"
+#include "tiny_exception.h"
+
 namespace tiny {
 
+	typedef u32 ModuleHandle;
+
 	class OrcJit
 	{
 	public:
-		OrcJit(llvm::TargetMachine& tm): data_layout_(tm.createDataLayout()), compile_layer_(object_layer_, llvm::orc::SimpleCompiler(tm)) {}
+		typedef llvm::orc::ObjectLinkingLayer<> ObjectLayer;
+		typedef llvm::orc::IRCompileLayer<ObjectLayer> CompileLayer;
+		typedef llvm::orc::CompileOnDemandLayer<CompileLayer> LazyLayer;
+
+		// With lazy set every function is replaced by a stub and only compiled the first time it is called
+		OrcJit(llvm::TargetMachine& tm, bool lazy = false): data_layout_(tm.createDataLayout()), compile_layer_(object_layer_, llvm::orc::SimpleCompiler(tm)),
+			memory_pool_(nullptr), next_handle_(0), code_size_(0), code_size_limit_(0), clock_(0)
+		{
+			// Makes the symbols of the executable itself visible to getSymbolAddressInProcess
+			llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+			if (!lazy)
+				return;
+
+			if (!is_lazy_supported(tm.getTargetTriple()))
+				throw TinyException("Lazy compilation is not supported on " + tm.getTargetTriple().str() + ", it needs x86_64 Linux or macOS");
+
+			callback_manager_ = std::make_unique<llvm::orc::LocalJITCompileCallbackManager<llvm::orc::OrcX86_64>>(0);
+			lazy_layer_ = std::make_unique<LazyLayer>(compile_layer_, extract_single_function, *callback_manager_, []() {
+				return std::make_unique<llvm::orc::LocalIndirectStubsManager<llvm::orc::OrcX86_64>>();
+			});
+		}
+
+		// The compile callbacks save and restore the System V argument registers, so the Windows x64 convention and
+		// every other architecture are out
+		static bool is_lazy_supported(const llvm::Triple& triple)
+		{
+			return triple.getArch() == llvm::Triple::x86_64 && !triple.isOSWindows();
+		}
 
-		void add_module(std::unique_ptr<llvm::Module> module)
+		// context is the one module was created in, the JIT keeps it alive for as long as the code may be needed. It can
+		// be nullptr if the caller keeps the context alive itself.
+		ModuleHandle add_module(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context = nullptr)
 		{
+			auto loaded = std::make_unique<LoadedModule>();
+			loaded->context = std::move(context);
+
+			for (auto& f : *module)
+			{
+				if (f.isDeclaration())
+					continue;
+
+				auto name = f.getName().str();
+				loaded->signatures[name] = get_signature(*f.getFunctionType());
+				loaded->symbols.push_back(mangle(name));
+			}
+
 			std::vector<std::unique_ptr<llvm::Module>> vec;
 			vec.push_back(std::move(module));
-			compile_layer_.addModuleSet(std::move(vec), std::make_unique<llvm::SectionMemoryManager>(), std::make_unique<llvm::orc::NullResolver>());
+
+			auto memory_manager = create_memory_manager(*loaded);
+
+			if (lazy_layer_)
+			{
+				loaded->lazy = true;
+				loaded->lazy_module = lazy_layer_->addModuleSet(std::move(vec), std::move(memory_manager), create_resolver(*loaded));
+			}
+			else
+			{
+				loaded->objects = compile_layer_.addModuleSet(std::move(vec), std::move(memory_manager), create_resolver(*loaded));
+			}
+
+			return register_module(std::move(loaded));
+		}
+
+		// Modules added from now on allocate their code and data from pool instead of mapping pages of their own. The
+		// pool has to outlive the JIT, it can be shared by several of them.
+		void set_memory_pool(MemoryPool* pool)
+		{
+			memory_pool_ = pool;
+		}
+
+		// Objects produced by modules passed to add_module are stored in cache, and loaded from it instead of being
+		// compiled when the module identifier matches
+		void set_object_cache(llvm::ObjectCache* cache)
+		{
+			compile_layer_.setObjectCache(cache);
+		}
+
+		// Links an already compiled object, e.g. one loaded from an ObjectCache
+		ModuleHandle add_object(std::unique_ptr<llvm::MemoryBuffer> buffer)
+		{
+			auto object = llvm::object::ObjectFile::createObjectFile(buffer->getMemBufferRef());
+			if (!object)
+				throw TinyException("Could not load object: " + object.getError().message());
+
+			return add_object(llvm::object::OwningBinary<llvm::object::ObjectFile>(std::move(object.get()), std::move(buffer)));
+		}
+
+		// Undefined symbols of the object resolve to everything else added to this JIT
+		ModuleHandle add_object(llvm::object::OwningBinary<llvm::object::ObjectFile> object)
+		{
+			auto loaded = std::make_unique<LoadedModule>();
+			loaded->object = std::make_unique<llvm::object::OwningBinary<llvm::object::ObjectFile>>(std::move(object));
+
+			for (auto& symbol : loaded->object->getBinary()->symbols())
+			{
+				auto flags = symbol.getFlags();
+				if (!(flags & llvm::object::BasicSymbolRef::SF_Global) || (flags & llvm::object::BasicSymbolRef::SF_Undefined))
+					continue;
+
+				auto name = symbol.getName();
+				if (name)
+					loaded->symbols.push_back(name->str());
+			}
+
+			std::vector<llvm::object::ObjectFile*> objects;
+			objects.push_back(loaded->object->getBinary());
+			loaded->objects = object_layer_.addObjectSet(std::move(objects), create_memory_manager(*loaded), create_resolver(*loaded));
+
+			return register_module(std::move(loaded));
+		}
+
+		// Frees the code and data of the module. Pointers into it, including calls to it from other modules that were
+		// already linked, are dangling afterwards.
+		void remove_module(ModuleHandle handle)
+		{
+			auto it = modules_.find(handle);
+			if (it == modules_.end())
+				throw TinyException("Unknown module handle: " + std::to_string(handle));
+
+			auto& loaded = *it->second;
+			if (loaded.lazy)
+				lazy_layer_->removeModuleSet(loaded.lazy_module);
+			else
+				object_layer_.removeObjectSet(loaded.objects);
+
+			code_size_ -= loaded.code_size;
+
+			// Handles are never reused, a dependency that was removed explicitly is simply gone
+			for (auto dependency : loaded.dependencies)
+			{
+				auto used = modules_.find(dependency);
+				if (used != modules_.end())
+					used->second->user_count--;
+			}
+
+			for (auto& symbol : loaded.symbols)
+			{
+				auto owners = symbol_modules_.find(symbol);
+				if (owners == symbol_modules_.end())
+					continue;
+
+				auto& handles = owners->second;
+				handles.erase(std::remove(handles.begin(), handles.end(), handle), handles.end());
+				if (handles.empty())
+					symbol_modules_.erase(owners);
+			}
+
+			modules_.erase(it);
+		}
+
+		// Bytes of code and data allocated for all modules that are currently loaded
+		size_t get_code_size() const
+		{
+			return code_size_;
+		}
+
+		// Once the loaded code exceeds bytes the least recently used modules are removed, a module counts as used when
+		// it is added and when a function of it is looked up. 0 disables the limit.
+		//
+		// Eviction frees code behind the caller's back, so every pointer returned by get_function_ptr and
+		// get_batch_function may dangle after the next add_module, add_object or unpin. Pin a module for as long as
+		// such pointers are used. Modules that other loaded modules linked against, e.g. the partitions of one
+		// program, are not evicted before those are.
+		void set_code_size_limit(size_t bytes)
+		{
+			code_size_limit_ = bytes;
+			evict(next_handle_);
+		}
+
+		// A pinned module is never evicted, remove_module still removes it. Pins nest, every pin needs an unpin.
+		void pin(ModuleHandle handle)
+		{
+			get_module(handle).pin_count++;
+		}
+
+		void unpin(ModuleHandle handle)
+		{
+			auto& loaded = get_module(handle);
+			if (loaded.pin_count == 0)
+				throw TinyException("Module " + std::to_string(handle) + " is not pinned");
+
+			loaded.pin_count--;
+			evict(next_handle_);
+		}
+
+		// Binds ext fn declarations named name to address, ahead of the symbols of the host process. Calls go straight
+		// to address, so it has to have the C calling convention and the declared signature.
+		void register_native(const std::string& name, void* address)
+		{
+			external_symbols_[mangle(name)] = static_cast<llvm::orc::TargetAddress>(reinterpret_cast<uintptr_t>(address));
+		}
+
+		// Signatures of modules passed to add_module are recorded automatically, objects carry no type information.
+		// Ignored if the module does not define name, so the signatures of a whole program can be handed to each of
+		// the objects it was split into.
+		void add_signature(ModuleHandle handle, const std::string& name, FnSignature signature)
+		{
+			auto& loaded = get_module(handle);
+			if (std::find(loaded.symbols.begin(), loaded.symbols.end(), mangle(name)) != loaded.symbols.end())
+				loaded.signatures[name] = std::move(signature);
 		}
 
+		// A plain function pointer to the function name of the module handle. TSignature is checked against the
+		// signature the function was declared with, if the JIT knows it, so a mismatch throws here instead of
+		// corrupting the stack.
 		template<class TSignature>
-		std::function<TSignature> get_function_ptr(std::string name, bool exported_symbols_only = false)
+		TSignature* get_function_ptr(ModuleHandle handle, const std::string& name, bool exported_symbols_only = false)
 		{
-			auto symbol = compile_layer_.findSymbol(mangle(name), exported_symbols_only);
-			return reinterpret_cast<TSignature*>(symbol.getAddress());
+			auto& loaded = get_module(handle);
+
+			auto expected = NativeSignature<TSignature>::get();
+			auto it = loaded.signatures.find(name);
+			if (it != loaded.signatures.end() && it->second != expected)
+				throw TinyException("The function '" + name + "' has the signature " + it->second.get_name() + ", requested was " + expected.get_name());
+
+			auto symbol = find_symbol_in(loaded, mangle(name), exported_symbols_only);
+			if (!symbol)
+				throw TinyException("Unknown function: " + name);
+
+			loaded.last_used = ++clock_;
+
+			return reinterpret_cast<TSignature*>(static_cast<uintptr_t>(symbol.getAddress()));
+		}
+
+		// Looks name up in the module that was added first among those defining it, like the linker does
+		template<class TSignature>
+		TSignature* get_function_ptr(const std::string& name, bool exported_symbols_only = false)
+		{
+			auto owners = symbol_modules_.find(mangle(name));
+			if (owners == symbol_modules_.end())
+				throw TinyException("Unknown function: " + name);
+
+			return get_function_ptr<TSignature>(owners->second.front(), name, exported_symbols_only);
+		}
+
+		// The batch wrapper of the scalar function name, only available if CodeGen was asked to emit batch functions
+		template<class TSignature>
+		typename BatchSignature<TSignature>::Type* get_batch_function(ModuleHandle handle, const std::string& name)
+		{
+			return get_function_ptr<typename BatchSignature<TSignature>::Type>(handle, get_batch_function_name(name));
+		}
+
+		template<class TSignature>
+		typename BatchSignature<TSignature>::Type* get_batch_function(const std::string& name)
+		{
+			return get_function_ptr<typename BatchSignature<TSignature>::Type>(get_batch_function_name(name));
 		}
 
 	private:
+		// Everything a module added to the JIT owns, only one of objects and lazy_module is used
+		struct LoadedModule
+		{
+			LoadedModule() : lazy(false), code_size(0), last_used(0), pin_count(0), user_count(0) {}
+
+			bool lazy;
+			ObjectLayer::ObjSetHandleT objects;
+			LazyLayer::ModuleSetHandleT lazy_module;
+			// The context the module was created in, if the JIT owns it
+			std::unique_ptr<llvm::LLVMContext> context;
+			// Set for modules added as an object
+			std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>> object;
+			// Mangled names of the symbols it defines
+			std::vector<std::string> symbols;
+			// Keyed by the unmangled function name
+			llvm::StringMap<FnSignature> signatures;
+			size_t code_size;
+			u64 last_used;
+			u32 pin_count;
+			// Number of loaded modules with this one in their dependencies
+			u32 user_count;
+			// Other modules this one resolved symbols from
+			std::unordered_set<ModuleHandle> dependencies;
+		};
+
 		llvm::DataLayout data_layout_;
-		llvm::orc::ObjectLinkingLayer<> object_layer_;
-		llvm::orc::IRCompileLayer<llvm::orc::ObjectLinkingLayer<>> compile_layer_;
+		// Destroyed after the layers, contexts and objects have to outlive the code compiled from them
+		std::unordered_map<ModuleHandle, std::unique_ptr<LoadedModule>> modules_;
+		ObjectLayer object_layer_;
+		CompileLayer compile_layer_;
+		// Only set for lazy compilation
+		std::unique_ptr<llvm::orc::JITCompileCallbackManager> callback_manager_;
+		std::unique_ptr<LazyLayer> lazy_layer_;
+		// nullptr if every module gets its own memory
+		MemoryPool* memory_pool_;
+		// Registered natives and every host symbol looked up so far, keyed by mangled name
+		llvm::StringMap<llvm::orc::TargetAddress> external_symbols_;
+		// The modules that define each mangled symbol, in the order they were added
+		llvm::StringMap<std::vector<ModuleHandle>> symbol_modules_;
+		ModuleHandle next_handle_;
+		size_t code_size_;
+		size_t code_size_limit_;
+		// Incremented on every use, orders modules for eviction
+		u64 clock_;
+
+		ModuleHandle register_module(std::unique_ptr<LoadedModule> loaded)
+		{
+			auto handle = next_handle_++;
+
+			for (auto& symbol : loaded->symbols)
+				symbol_modules_[symbol].push_back(handle);
+
+			loaded->last_used = ++clock_;
+			modules_[handle] = std::move(loaded);
+
+			evict(handle);
+			return handle;
+		}
+
+		std::unique_ptr<llvm::RTDyldMemoryManager> create_memory_manager(LoadedModule& loaded)
+		{
+			if (memory_pool_)
+				return std::make_unique<PooledMemoryManager>(memory_pool_, &loaded.code_size, &code_size_);
+
+			return std::make_unique<CountingMemoryManager>(&loaded.code_size, &code_size_);
+		}
+
+		LoadedModule& get_module(ModuleHandle handle)
+		{
+			auto it = modules_.find(handle);
+			if (it == modules_.end())
+				throw TinyException("Unknown module handle: " + std::to_string(handle));
+
+			return *it->second;
+		}
+
+		// Removes least recently used modules until the limit is met. keep, pinned modules and modules others depend on
+		// are never removed, removing a module can make its dependencies removable in the next iteration.
+		void evict(ModuleHandle keep)
+		{
+			while (code_size_limit_ != 0 && code_size_ > code_size_limit_)
+			{
+				auto victim = modules_.end();
+				for (auto it = modules_.begin(); it != modules_.end(); ++it)
+				{
+					auto& loaded = *it->second;
+					if (it->first == keep || loaded.pin_count != 0 || loaded.user_count != 0)
+						continue;
+
+					if (victim == modules_.end() || loaded.last_used < victim->second->last_used)
+						victim = it;
+				}
+
+				if (victim == modules_.end())
+					return;
+
+				remove_module(victim->first);
+			}
+		}
+
+		static Type get_type(llvm::Type* type)
+		{
+			if (type->isVoidTy())
+				return Type::Void;
+
+			if (type->isIntegerTy(32))
+				return Type::I32;
+
+			if (type->isIntegerTy(8))
+				return Type::I8;
+
+			if (type->isPointerTy())
+			{
+				auto element = type->getPointerElementType();
+				if (element->isIntegerTy(32))
+					return Type::I32Ptr;
+
+				if (element->isIntegerTy(8))
+					return Type::I8Ptr;
+			}
+
+			return Type::Unresolved;
+		}
+
+		static FnSignature get_signature(llvm::FunctionType& type)
+		{
+			FnSignature signature;
+			signature.return_type = get_type(type.getReturnType());
+
+			for (auto param : type.params())
+				signature.args.push_back(get_type(param));
+
+			return signature;
+		}
+
+		llvm::orc::JITSymbol find_symbol_in(LoadedModule& loaded, const std::string& name, bool exported_symbols_only)
+		{
+			if (loaded.lazy)
+				return lazy_layer_->findSymbolIn(loaded.lazy_module, name, exported_symbols_only);
+
+			return object_layer_.findSymbolIn(loaded.objects, name, exported_symbols_only);
+		}
+
+		// Each function is compiled in its own partition, the stubs of its callees resolve through the lazy layer
+		static std::set<llvm::Function*> extract_single_function(llvm::Function& f)
+		{
+			std::set<llvm::Function*> partition;
+			partition.insert(&f);
+			return partition;
+		}
+
+		// Symbols that are not defined by JIT code, registered natives first and then the host process
+		llvm::RuntimeDyld::SymbolInfo find_external_symbol(const std::string& name)
+		{
+			auto it = external_symbols_.find(name);
+			if (it != external_symbols_.end())
+				return llvm::RuntimeDyld::SymbolInfo(it->second, llvm::JITSymbolFlags::Exported);
+
+			// The process exports C names, but getSymbolAddressInProcess only strips the global prefix on Apple. It
+			// is still asked afterwards for the few symbols it special cases.
+			auto address = static_cast<llvm::orc::TargetAddress>(reinterpret_cast<uintptr_t>(llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(unmangle(name))));
+			if (address == 0)
+				address = static_cast<llvm::orc::TargetAddress>(llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name));
+
+			if (address == 0)
+				return llvm::RuntimeDyld::SymbolInfo(nullptr);
+
+			external_symbols_[name] = address;
+			return llvm::RuntimeDyld::SymbolInfo(address, llvm::JITSymbolFlags::Exported);
+		}
+
+		// Resolves name to the module that was added first among those defining it, like get_function_ptr, and records
+		// that user depends on that module
+		llvm::RuntimeDyld::SymbolInfo find_jit_symbol(LoadedModule& user, const std::string& name)
+		{
+			auto owners = symbol_modules_.find(name);
+			if (owners == symbol_modules_.end())
+				return llvm::RuntimeDyld::SymbolInfo(nullptr);
+
+			auto handle = owners->second.front();
+			auto& owner = get_module(handle);
+
+			auto symbol = find_symbol_in(owner, name, false);
+			if (!symbol)
+				return llvm::RuntimeDyld::SymbolInfo(nullptr);
+
+			if (&owner != &user && user.dependencies.insert(handle).second)
+				owner.user_count++;
+
+			return llvm::RuntimeDyld::SymbolInfo(symbol.getAddress(), symbol.getFlags());
+		}
+
+		// The resolver of the module user, it lives as long as the module
+		std::unique_ptr<llvm::RuntimeDyld::SymbolResolver> create_resolver(LoadedModule& user)
+		{
+			auto module = &user;
+			return llvm::orc::createLambdaResolver(
+				[this, module](const std::string& name) {
+					return find_jit_symbol(*module, name);
+				},
+				[this](const std::string& name) {
+					return find_external_symbol(name);
+				});
+		}
+
+		// The C name of a mangled symbol, e.g. _puts -> puts on Win32
+		std::string unmangle(const std::string& name) const
+		{
+			auto prefix = data_layout_.getGlobalPrefix();
+			if (prefix != '\0' && !name.empty() && name[0] == prefix)
+				return name.substr(1);
+
+			return name;
+		}
 
 		std::string mangle(std::string name) const
 		{
@@ -46,4 +512,4 @@ namespace tiny {
 			return mangled_name;
 		}
 	};
-}
\ No newline at end of file
+}
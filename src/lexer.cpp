@@ -3,21 +3,31 @@
 
 namespace tiny {
 
-	Lexer::Lexer(const std::string& path) : path_(path), file_(path), line_number_(1), column_(0)
+	std::unique_ptr<llvm::MemoryBuffer> Lexer::open_source(const std::string& path)
 	{
-		if (!file_.good())
+		// MemoryBuffer maps large files and guarantees a null terminator, which we use as the EOF sentinel
+		auto buffer = llvm::MemoryBuffer::getFile(path);
+		if (!buffer)
 		{
 			throw TinyException("Could not open source file: %s", path.c_str());
 		}
 
-		consume();
-		init_keywords();
+		return std::move(buffer.get());
 	}
 
-	Lexer::~Lexer()
+	Lexer::Lexer(const std::string& path, Interner* interner) : Lexer(open_source(path), interner)
 	{
-		if (file_.is_open())
-			file_.close();
+	}
+
+	Lexer::Lexer(std::unique_ptr<llvm::MemoryBuffer> source, Interner* interner) : scanner_(get_char_scanner()), interner_(interner), line_number_(1), column_(1)
+	{
+		source_ = std::move(source);
+		cursor_ = source_->getBufferStart();
+		end_ = source_->getBufferEnd();
+		line_offsets_.push_back(0);
+
+		file_id_ = static_cast<u32>(files_.size());
+		files_.push_back(std::string(source_->getBufferIdentifier()));
 	}
 
 	std::unique_ptr<Token> Lexer::next()
@@ -29,166 +39,185 @@ namespace tiny {
 			return next;
 		}
 
-		while (current_ != -1)
+		auto type = lex();
+		auto end_column = token_length_ > 0 ? token_column_ + (token_length_ - 1) : token_column_;
+
+		return std::make_unique<Token>(type, llvm::StringRef(token_start_, token_length_), file_id_, line_number_, token_column_, end_column);
+	}
+
+	const Token* Lexer::peek()
+	{
+		buffer_.push(next());
+		return buffer_.back().get();
+	}
+
+	TokenStream Lexer::tokenize()
+	{
+		TokenStream stream;
+		stream.source = source_->getBufferStart();
+		stream.file_id = file_id_;
+
+		// Rough guess to avoid most of the reallocations, generated code averages well above 4 bytes per token
+		auto expected_tokens = source_->getBufferSize() / 4;
+		stream.kinds.reserve(expected_tokens);
+		stream.offsets.reserve(expected_tokens);
+		stream.lengths.reserve(expected_tokens);
+		stream.symbols.reserve(expected_tokens);
+
+		for (;;)
+		{
+			auto type = lex();
+
+			stream.kinds.push_back(type);
+			stream.offsets.push_back(static_cast<u32>(token_start_ - stream.source));
+			stream.lengths.push_back(token_length_);
+			stream.symbols.push_back(type == TokenType::Id ? interner_->intern(llvm::StringRef(token_start_, token_length_)) : 0);
+
+			if (type == TokenType::Eof)
+				break;
+		}
+
+		stream.line_offsets = std::move(line_offsets_);
+
+		return stream;
+	}
+
+	const std::string& Lexer::get_file_name(u32 file_id) const
+	{
+		return files_[file_id];
+	}
+
+	Interner* Lexer::interner() const
+	{
+		return interner_;
+	}
+
+	TokenType Lexer::lex()
+	{
+		for (;;)
 		{
-			if(current_ == '\n')
+			auto c = static_cast<unsigned char>(*cursor_);
+
+			if(c == '\n')
 			{
 				new_line();
 				continue;
 			}
 
-			if(isspace(current_))
+			if(isspace(c))
 			{
-				consume();
+				consume(scanner_.whitespace(cursor_));
 				continue;
 			}
 
-			if (isalpha(current_))
+			if (isalpha(c))
 			{
 				return alpha();
 			}
 
-			if (isdigit(current_))
+			if (isdigit(c))
 			{
 				return digit();
 			}
 
-			switch (current_)
+			switch (c)
 			{
+			case '\0':
+				// Only the sentinel terminates the source, a stray null character is an error
+				if (cursor_ == end_)
+					return create(TokenType::Eof, 0);
+				break;
 			case '"':
 				return string();
 			case '+':
-				return create(TokenType::Plus, "+");
-			case '-': {
-				auto t = try_match_tokens('-', '>', TokenType::RArrow);
-				if (t != nullptr)
-					return t;
+				return create(TokenType::Plus, 1);
+			case '-':
+				if (peek_char() == '>')
+					return create(TokenType::RArrow, 2);
 
-				return create(TokenType::Minus, "-");
-			}
+				return create(TokenType::Minus, 1);
 			case '=':
-				return create(TokenType::Assign, "=");
+				return create(TokenType::Assign, 1);
 			case '*':
-				return create(TokenType::Star, "*");
+				return create(TokenType::Star, 1);
 			case '/':
-				return create(TokenType::Divide, "/");
+				return create(TokenType::Divide, 1);
 			case '(':
-				return create(TokenType::LParen, "(");
+				return create(TokenType::LParen, 1);
 			case ')':
-				return create(TokenType::RParen, ")");
+				return create(TokenType::RParen, 1);
 			case '{':
-				return create(TokenType::LBracket, "{");
+				return create(TokenType::LBracket, 1);
 			case '}':
-				return create(TokenType::RBracket, "}");
+				return create(TokenType::RBracket, 1);
 			case '[':
-				return create(TokenType::LSBracket, "[");
+				return create(TokenType::LSBracket, 1);
 			case ']':
-				return create(TokenType::RSBracket, "]");
+				return create(TokenType::RSBracket, 1);
 			case ',':
-				return create(TokenType::Comma, ",");
-			case ':': {
-				auto t = try_match_tokens(':', '=', TokenType::ShortDec);
-				if (t != nullptr)
-					return t;
-			}
+				return create(TokenType::Comma, 1);
+			case ':':
+				if (peek_char() == '=')
+					return create(TokenType::ShortDec, 2);
+				break;
 			}
 
 			throw TinyException("Unrecognised token, Line: %d Column: %d", line_number_, column_);
 		}
-
-		return create(TokenType::Eof, "");
-	}
-
-	const Token* Lexer::peek()
-	{
-		buffer_.push(next());
-		return buffer_.back().get();
 	}
 
-	std::unique_ptr<Token> Lexer::string()
+	TokenType Lexer::string()
 	{
-		std::string value;
-		u32 start = column_;
+		// The token value excludes the quotes but the token still starts at the opening one
+		token_column_ = column_;
 		consume();
 
-		while (current_ != -1 && current_ != L'"')
+		token_start_ = cursor_;
+		consume(scanner_.string_body(cursor_));
+
+		// The body scan also stops at null characters, only the sentinel ends the literal early
+		while (*cursor_ != '"')
 		{
-			value += current_;
+			if (cursor_ == end_)
+				throw TinyException("Unterminated string literal, Line: %d Column: %d", line_number_, token_column_);
+
 			consume();
+			consume(scanner_.string_body(cursor_));
 		}
 
+		token_length_ = static_cast<u32>(cursor_ - token_start_);
 		consume();
 
-		return std::make_unique<Token>(TokenType::StringLiteral, value, path_, line_number_, start, start + (value.size() - 1));
+		return TokenType::StringLiteral;
 	}
 
-	std::unique_ptr<Token> Lexer::alpha()
+	TokenType Lexer::alpha()
 	{
-		std::string value;
-		u32 start = column_;
-		while (current_ != -1 && (isalnum(current_) || current_ == L'_'))
-		{
-			value += current_;
-			consume();
-		}
-
-		auto t = match_keyword(value, start, start + (value.size() - 1));
-		if (t != nullptr)
-			return t;
-
-		return std::make_unique<Token>(TokenType::Id, value, path_, line_number_, start, start + (value.size() - 1));
+		create(TokenType::Id, scanner_.identifier(cursor_));
+		return match_keyword(llvm::StringRef(token_start_, token_length_));
 	}
 
-	std::unique_ptr<Token> Lexer::digit()
+	TokenType Lexer::digit()
 	{
-		std::string value;
-		u32 start = column_;
-
-		while (current_ != -1 && isdigit(current_))
-		{
-			value += current_;
-			consume();
-		}
-
-		return std::make_unique<Token>(TokenType::IntLiteral, value, path_, line_number_, start, start + (value.size() - 1));
+		return create(TokenType::IntLiteral, scanner_.digits(cursor_));
 	}
 
-	std::unique_ptr<Token> Lexer::try_match_tokens(char first, char second, TokenType type)
+	void Lexer::consume()
 	{
-		if (current_ == first && peek_char() == second)
-		{
-			u32 start = column_;
-			std::string value;
-			value += current_;
-			consume();
-			value += current_;
-
-			return create(type, value, start, start + 1);
-		}
-
-		return nullptr;
+		column_++;
+		cursor_++;
 	}
 
-	void Lexer::consume()
+	void Lexer::consume(u32 count)
 	{
-		if (!file_.eof())
-		{
-			column_++;
-			current_ = file_.get();
-			return;
-		}
-
-		current_ = -1;
+		column_ += count;
+		cursor_ += count;
 	}
 
 	char Lexer::peek_char()
 	{
-		if (!file_.eof())
-		{
-			return file_.peek();
-		}
-
-		return -1;
+		// Never reads past the sentinel since it is only called while the current character is not '\0'
+		return cursor_[1];
 	}
 
 	void Lexer::new_line()
@@ -196,44 +225,58 @@ namespace tiny {
 		column_ = 0;
 		line_number_++;
 		consume();
+		line_offsets_.push_back(static_cast<u32>(cursor_ - source_->getBufferStart()));
 	}
 
-	std::unique_ptr<Token> Lexer::create(TokenType type, const std::string& value)
+	TokenType Lexer::create(TokenType type, u32 length)
 	{
-		return create(type, value, column_, column_);
-	}
+		token_start_ = cursor_;
+		token_length_ = length;
+		token_column_ = column_;
+		consume(length);
 
-	std::unique_ptr<Token> Lexer::create(TokenType type, const std::string& value, u32 start_col, u32 end_col)
-	{
-		consume();
-		return std::make_unique<Token>(type, value, path_, line_number_, start_col, end_col);
+		return type;
 	}
 
-	std::unique_ptr<Token> Lexer::match_keyword(const std::string& value, u32 start_col, u32 end_col)
+	TokenType Lexer::match_keyword(llvm::StringRef value)
 	{
-		auto it = keywords_.find(value);
-		if (it != keywords_.end())
+		// Dispatch on length and first character, so identifiers are never hashed and no keyword table is built per Lexer
+		switch (value.size())
 		{
-			const auto& t = it->second;
-			return std::make_unique<Token>(t->type, value, path_, line_number_, start_col, end_col);
+		case 2:
+			switch (value[0])
+			{
+			case 'f':
+				if (value[1] == 'n')
+					return TokenType::Fn;
+				break;
+			case 'i':
+				// Types
+				if (value[1] == '8')
+					return TokenType::I8;
+				break;
+			}
+			break;
+		case 3:
+			switch (value[0])
+			{
+			case 'e':
+				if (value == "ext")
+					return TokenType::Ext;
+				break;
+			case 'r':
+				if (value == "ret")
+					return TokenType::Ret;
+				break;
+			case 'i':
+				// Types
+				if (value == "i32")
+					return TokenType::I32;
+				break;
+			}
+			break;
 		}
 
-		return nullptr;
-	}
-
-	void Lexer::register_keyword(const std::string keyword, TokenType type)
-	{
-		keywords_.insert(std::pair<std::string, std::unique_ptr<Token>>(keyword, std::make_unique<Token>(type, keyword, path_, line_number_, 0, 0)));
-	}
-
-	void Lexer::init_keywords()
-	{
-		register_keyword("fn", TokenType::Fn);
-		register_keyword("ext", TokenType::Ext);
-		register_keyword("ret", TokenType::Ret);
-
-		// Types
-		register_keyword("i32", TokenType::I32);
-		register_keyword("i8", TokenType::I8);
+		return TokenType::Id;
 	}
 }
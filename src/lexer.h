@@ -1,43 +1,60 @@
 #pragma once
 
-#include <fstream>
 #include <string>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 #include <queue>
 
+#include "llvm/Support/MemoryBuffer.h"
+
 #include "type.h"
 #include "token.h"
+#include "scanner.h"
 
 namespace tiny {
 
 	class Lexer
 	{
 	public:
-		Lexer(const std::string& path);
-		~Lexer();
+		Lexer(const std::string& path, Interner* interner);
+		// Lexes source from memory, errors refer to it by its buffer identifier. It has to be null terminated.
+		Lexer(std::unique_ptr<llvm::MemoryBuffer> source, Interner* interner);
+		// Reads the file at path the way the path constructor does, throws if it can not be opened
+		static std::unique_ptr<llvm::MemoryBuffer> open_source(const std::string& path);
 		std::unique_ptr<Token> next();
 		const Token* peek();
+		// Lexes the whole file at once, can not be mixed with next() and peek()
+		TokenStream tokenize();
+		const std::string& get_file_name(u32 file_id) const;
+		Interner* interner() const;
 	private:
-		std::unique_ptr<Token> string();
-		std::unique_ptr<Token> alpha();
-		std::unique_ptr<Token> digit();
-		std::unique_ptr<Token> try_match_tokens(char first, char second, TokenType type);
+		TokenType lex();
+		TokenType string();
+		TokenType alpha();
+		TokenType digit();
 		void consume();
+		void consume(u32 count);
 		char peek_char();
 		void new_line();
-		std::unique_ptr<Token> create(TokenType type, const std::string& value);
-		std::unique_ptr<Token> create(TokenType type, const std::string& value, u32 start_col, u32 end_col);
-		std::unique_ptr<Token> match_keyword(const std::string& value, u32 start_col, u32 end_col);
-		void register_keyword(const std::string keyword, TokenType type);
-		void init_keywords();
-
-		std::string path_;
-		std::ifstream file_;
-		char current_;
+		TokenType create(TokenType type, u32 length);
+		static TokenType match_keyword(llvm::StringRef value);
+
+		// Every token refers to its file through an index into this table
+		std::vector<std::string> files_;
+		u32 file_id_;
+		// The whole source file, terminated by a '\0' sentinel
+		std::unique_ptr<llvm::MemoryBuffer> source_;
+		const char* cursor_;
+		const char* end_;
+		const CharScanner& scanner_;
+		Interner* interner_;
 		u32 line_number_;
 		u32 column_;
-		std::unordered_map<std::string, std::unique_ptr<Token>> keywords_;
+		std::vector<u32> line_offsets_;
+		// The token most recently produced by lex()
+		const char* token_start_;
+		u32 token_length_;
+		u32 token_column_;
 		std::queue<std::unique_ptr<Token>> buffer_;
 	};
 
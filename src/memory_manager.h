@@ -0,0 +1,178 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include "llvm/Support/Memory.h"
+
+#include "memory_pool.h"
+
+namespace tiny {
+
+	// The EH frames a memory manager registered with the unwinder. The unwinder keeps reading a frame until it is
+	// deregistered, so the owner has to call deregister_all before the memory holding the frames is released.
+	class RegisteredEHFrames
+	{
+	public:
+		void add(uint8_t* address, uint64_t load_address, size_t size)
+		{
+			frames_.push_back(Frame{ address, load_address, size });
+		}
+
+		// Returns false if address was not added or already removed
+		bool remove(uint8_t* address)
+		{
+			for (auto it = frames_.begin(); it != frames_.end(); ++it)
+			{
+				if (it->address != address)
+					continue;
+
+				frames_.erase(it);
+				return true;
+			}
+
+			return false;
+		}
+
+		void deregister_all()
+		{
+			for (auto& frame : frames_)
+				llvm::RTDyldMemoryManager::deregisterEHFramesInProcess(frame.address, frame.size);
+
+			frames_.clear();
+		}
+
+	private:
+		struct Frame
+		{
+			uint8_t* address;
+			uint64_t load_address;
+			size_t size;
+		};
+
+		std::vector<Frame> frames_;
+	};
+
+	// SectionMemoryManager that adds the size of every section it allocates to a counter owned by the caller. All of
+	// the memory is released when the manager is destroyed, which ORC does when the object it loaded is removed.
+	class CountingMemoryManager : public llvm::SectionMemoryManager
+	{
+	public:
+		CountingMemoryManager(size_t* module_size, size_t* total_size) : module_size_(module_size), total_size_(total_size) {}
+
+		// ORC does not deregister the frames of a removed object, the base class destructor unmaps them right after
+		~CountingMemoryManager()
+		{
+			eh_frames_.deregister_all();
+		}
+
+		uint8_t* allocateCodeSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name) override
+		{
+			count(size);
+			return llvm::SectionMemoryManager::allocateCodeSection(size, alignment, section_id, section_name);
+		}
+
+		uint8_t* allocateDataSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name, bool read_only) override
+		{
+			count(size);
+			return llvm::SectionMemoryManager::allocateDataSection(size, alignment, section_id, section_name, read_only);
+		}
+
+		void registerEHFrames(uint8_t* address, uint64_t load_address, size_t size) override
+		{
+			llvm::SectionMemoryManager::registerEHFrames(address, load_address, size);
+			eh_frames_.add(address, load_address, size);
+		}
+
+		void deregisterEHFrames(uint8_t* address, uint64_t load_address, size_t size) override
+		{
+			if (eh_frames_.remove(address))
+				llvm::SectionMemoryManager::deregisterEHFrames(address, load_address, size);
+		}
+
+	private:
+		void count(uintptr_t size)
+		{
+			*module_size_ += size;
+			*total_size_ += size;
+		}
+
+		RegisteredEHFrames eh_frames_;
+		size_t* module_size_;
+		size_t* total_size_;
+	};
+
+	// Allocates the sections of one module from a MemoryPool shared with other modules and counts their size like
+	// CountingMemoryManager. The sections are handed back to the pool when the manager is destroyed.
+	class PooledMemoryManager : public llvm::RTDyldMemoryManager
+	{
+	public:
+		PooledMemoryManager(MemoryPool* pool, size_t* module_size, size_t* total_size) : pool_(pool), module_size_(module_size), total_size_(total_size) {}
+
+		~PooledMemoryManager()
+		{
+			// The pool hands the addresses to the next module right away, a stale frame would describe its code
+			eh_frames_.deregister_all();
+
+			for (auto& section : code_sections_)
+				pool_->release(section.first, section.second);
+
+			for (auto& section : data_sections_)
+				pool_->release(section.first, section.second);
+		}
+
+		uint8_t* allocateCodeSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name) override
+		{
+			return allocate(MemoryPool::Purpose::Code, size, alignment, code_sections_);
+		}
+
+		uint8_t* allocateDataSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name, bool read_only) override
+		{
+			return allocate(MemoryPool::Purpose::Data, size, alignment, data_sections_);
+		}
+
+		// Code pages are shared with other modules and stay writable, only the instruction cache has to be flushed
+		bool finalizeMemory(std::string* error_message = nullptr) override
+		{
+			for (auto& section : code_sections_)
+				llvm::sys::Memory::InvalidateInstructionCache(section.first, section.second);
+
+			return false;
+		}
+
+		void registerEHFrames(uint8_t* address, uint64_t load_address, size_t size) override
+		{
+			llvm::RTDyldMemoryManager::registerEHFrames(address, load_address, size);
+			eh_frames_.add(address, load_address, size);
+		}
+
+		void deregisterEHFrames(uint8_t* address, uint64_t load_address, size_t size) override
+		{
+			if (eh_frames_.remove(address))
+				llvm::RTDyldMemoryManager::deregisterEHFrames(address, load_address, size);
+		}
+
+	private:
+		typedef std::vector<std::pair<uint8_t*, size_t>> Sections;
+
+		uint8_t* allocate(MemoryPool::Purpose purpose, uintptr_t size, unsigned alignment, Sections& sections)
+		{
+			auto address = pool_->allocate(purpose, size, alignment);
+			sections.push_back(std::make_pair(address, static_cast<size_t>(size)));
+
+			*module_size_ += size;
+			*total_size_ += size;
+			return address;
+		}
+
+		MemoryPool* pool_;
+		Sections code_sections_;
+		Sections data_sections_;
+		RegisteredEHFrames eh_frames_;
+		size_t* module_size_;
+		size_t* total_size_;
+	};
+
+}
@@ -0,0 +1,203 @@
+#include "memory_pool.h"
+
+#include "tiny_exception.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace tiny {
+
+	static const u32 no_slab = ~0u;
+
+	static uintptr_t align_up(uintptr_t value, uintptr_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// An empty block if huge pages are not available. The block can be released with releaseMappedMemory.
+	static llvm::sys::MemoryBlock map_huge_pages(size_t size, bool executable)
+	{
+#if defined(_WIN32)
+		// Needs the SeLockMemoryPrivilege, without it the allocation fails and normal pages are used
+		auto page_size = GetLargePageMinimum();
+		if (page_size == 0)
+			return llvm::sys::MemoryBlock();
+
+		auto rounded = align_up(size, page_size);
+		auto address = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, executable ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE);
+		if (!address)
+			return llvm::sys::MemoryBlock();
+
+		return llvm::sys::MemoryBlock(address, rounded);
+#elif defined(__linux__) && defined(MADV_HUGEPAGE)
+		// Transparent huge pages only back 2 MiB aligned ranges, so map one page more and trim it to the alignment
+		const uintptr_t page_size = 2 * 1024 * 1024;
+		auto rounded = align_up(size, page_size);
+		auto protection = PROT_READ | PROT_WRITE | (executable ? PROT_EXEC : 0);
+
+		auto address = mmap(nullptr, rounded + page_size, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (address == MAP_FAILED)
+			return llvm::sys::MemoryBlock();
+
+		auto start = reinterpret_cast<uintptr_t>(address);
+		auto aligned = align_up(start, page_size);
+		if (aligned != start)
+			munmap(address, aligned - start);
+
+		auto tail = start + rounded + page_size - (aligned + rounded);
+		if (tail != 0)
+			munmap(reinterpret_cast<void*>(aligned + rounded), tail);
+
+		// Only a hint, the kernel falls back to normal pages if it has no huge ones left
+		madvise(reinterpret_cast<void*>(aligned), rounded, MADV_HUGEPAGE);
+		return llvm::sys::MemoryBlock(reinterpret_cast<void*>(aligned), rounded);
+#else
+		(void)size;
+		(void)executable;
+		return llvm::sys::MemoryBlock();
+#endif
+	}
+
+	// The start of size bytes in block or nullptr if they do not fit
+	static u8* bump(llvm::sys::MemoryBlock& block, size_t& used, size_t size, unsigned alignment)
+	{
+		auto base = reinterpret_cast<uintptr_t>(block.base());
+		auto offset = align_up(base + used, alignment) - base;
+		if (offset + size > block.size())
+			return nullptr;
+
+		used = offset + size;
+		return reinterpret_cast<u8*>(base + offset);
+	}
+
+	MemoryPool::MemoryPool(size_t slab_size, bool huge_pages) : slab_size_(slab_size), huge_pages_(huge_pages)
+	{
+		current_[0] = no_slab;
+		current_[1] = no_slab;
+	}
+
+	MemoryPool::~MemoryPool()
+	{
+		for (auto& slab : slabs_)
+			llvm::sys::Memory::releaseMappedMemory(slab.block);
+	}
+
+	u8* MemoryPool::allocate(Purpose purpose, size_t size, unsigned alignment)
+	{
+		if (alignment == 0)
+			alignment = 16;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto& current = current_[static_cast<u8>(purpose)];
+		if (current != no_slab)
+		{
+			auto& slab = slabs_[current];
+			if (auto address = bump(slab.block, slab.used, size, alignment))
+			{
+				slab.live += size;
+				return address;
+			}
+		}
+
+		// Sections that do not fit into a normal slab get one of their own, it is unmapped when they are released
+		auto dedicated = size + alignment > slab_size_;
+		auto index = map_slab(purpose, dedicated ? size + alignment : slab_size_);
+		if (!dedicated)
+			current = index;
+
+		auto& slab = slabs_[index];
+		auto address = bump(slab.block, slab.used, size, alignment);
+		slab.live += size;
+		return address;
+	}
+
+	void MemoryPool::release(u8* address, size_t size)
+	{
+		// Empty sections may point one past the end of their slab
+		if (size == 0)
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		for (u32 i = 0; i < slabs_.size(); i++)
+		{
+			auto& slab = slabs_[i];
+			auto base = static_cast<u8*>(slab.block.base());
+			if (address < base || address >= base + slab.block.size())
+				continue;
+
+			slab.live -= size;
+			if (slab.live != 0)
+				return;
+
+			// The slab allocations go to is kept for the next module, every other empty slab is given back to the OS
+			if (current_[static_cast<u8>(slab.purpose)] == i)
+				slab.used = 0;
+			else
+				unmap_slab(i);
+
+			return;
+		}
+
+		throw TinyException("Released memory that does not belong to the pool");
+	}
+
+	size_t MemoryPool::get_mapped_size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		size_t size = 0;
+		for (auto& slab : slabs_)
+			size += slab.block.size();
+
+		return size;
+	}
+
+	u32 MemoryPool::map_slab(Purpose purpose, size_t size)
+	{
+		auto executable = purpose == Purpose::Code;
+
+		llvm::sys::MemoryBlock block;
+		if (huge_pages_)
+			block = map_huge_pages(size, executable);
+
+		if (!block.base())
+		{
+			// Placing slabs near each other keeps the distance between code and data small
+			auto flags = llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE | (executable ? llvm::sys::Memory::MF_EXEC : 0);
+			auto near_block = slabs_.empty() ? nullptr : &slabs_.back().block;
+
+			std::error_code error;
+			block = llvm::sys::Memory::allocateMappedMemory(size, near_block, flags, error);
+			if (error)
+				throw TinyException("Could not map JIT memory: " + error.message());
+		}
+
+		Slab slab;
+		slab.block = block;
+		slab.purpose = purpose;
+		slab.used = 0;
+		slab.live = 0;
+		slabs_.push_back(slab);
+
+		return static_cast<u32>(slabs_.size() - 1);
+	}
+
+	void MemoryPool::unmap_slab(u32 index)
+	{
+		llvm::sys::Memory::releaseMappedMemory(slabs_[index].block);
+		slabs_.erase(slabs_.begin() + index);
+
+		for (auto& current : current_)
+		{
+			if (current != no_slab && current > index)
+				current--;
+		}
+	}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "llvm/Support/Memory.h"
+
+#include "type.h"
+
+namespace tiny {
+
+	// Executable and data memory shared by the code of many JIT modules. Sections are bump allocated from large slabs
+	// instead of getting pages of their own, so small modules sit next to each other and use few TLB entries. A slab
+	// is reused once every section allocated from it has been released.
+	class MemoryPool
+	{
+	public:
+		enum class Purpose : u8
+		{
+			// Mapped read, write and execute for the whole lifetime of the slab. Pages are shared between modules,
+			// so they can not be made read only when one of them is finalized.
+			Code,
+			Data
+		};
+
+		static const size_t default_slab_size = 2 * 1024 * 1024;
+
+		// With huge_pages set the slabs are backed by huge pages where the OS supports it, slab_size should be a
+		// multiple of the huge page size then
+		MemoryPool(size_t slab_size = default_slab_size, bool huge_pages = false);
+		MemoryPool(const MemoryPool&) = delete;
+		MemoryPool& operator=(const MemoryPool&) = delete;
+		~MemoryPool();
+
+		u8* allocate(Purpose purpose, size_t size, unsigned alignment);
+		// size has to be the size address was allocated with
+		void release(u8* address, size_t size);
+
+		// Bytes mapped for all slabs
+		size_t get_mapped_size() const;
+
+	private:
+		struct Slab
+		{
+			llvm::sys::MemoryBlock block;
+			Purpose purpose;
+			// Offset of the first free byte
+			size_t used;
+			// Bytes of allocations that were not released yet
+			size_t live;
+		};
+
+		size_t slab_size_;
+		bool huge_pages_;
+		std::vector<Slab> slabs_;
+		// Index of the slab each purpose allocates from, ~0u if there is none yet
+		u32 current_[2];
+		mutable std::mutex mutex_;
+
+		u32 map_slab(Purpose purpose, size_t size);
+		void unmap_slab(u32 index);
+	};
+
+}
@@ -0,0 +1,128 @@
+#include "object_cache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace tiny {
+
+	static const char module_prefix[] = "tiny.";
+	// Bump whenever CodeGen changes the code it emits for the same source
+	static const char cache_version[] = "1";
+
+	ObjectCache::ObjectCache(std::string directory) : directory_(std::move(directory))
+	{
+	}
+
+	std::string ObjectCache::get_key(llvm::StringRef source, OptLevel level, bool batch_functions, const llvm::TargetMachine& tm)
+	{
+		// Every part is followed by a separator so that moving bytes from one part to the next changes the hash
+		char codegen_options[] = { static_cast<char>('0' + static_cast<u8>(level)), batch_functions ? 'b' : '-' };
+
+		llvm::MD5 hash;
+		hash.update(cache_version);
+		hash.update(llvm::StringRef("\0", 1));
+		hash.update(source);
+		hash.update(llvm::StringRef("\0", 1));
+		hash.update(llvm::StringRef(codegen_options, sizeof(codegen_options)));
+		hash.update(llvm::StringRef("\0", 1));
+		hash.update(tm.getTargetTriple().str());
+		hash.update(llvm::StringRef("\0", 1));
+		hash.update(tm.getTargetCPU());
+		hash.update(llvm::StringRef("\0", 1));
+		hash.update(tm.getTargetFeatureString());
+
+		llvm::MD5::MD5Result result;
+		hash.final(result);
+
+		llvm::SmallString<32> key;
+		llvm::MD5::stringifyResult(result, key);
+		return key.str().str();
+	}
+
+	std::string ObjectCache::get_module_identifier(const std::string& key)
+	{
+		return module_prefix + key;
+	}
+
+	std::unique_ptr<llvm::MemoryBuffer> ObjectCache::load(const std::string& key) const
+	{
+		auto buffer = llvm::MemoryBuffer::getFile(get_path(key), -1, false);
+		if (!buffer)
+			return nullptr;
+
+		return std::move(buffer.get());
+	}
+
+	void ObjectCache::remove(const std::string& key) const
+	{
+		llvm::sys::fs::remove(get_path(key));
+	}
+
+	void ObjectCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object)
+	{
+		std::string key;
+		if (!get_key_from_module(module, key))
+			return;
+
+		if (llvm::sys::fs::create_directories(directory_))
+			return;
+
+		// Written to a temporary file first so a concurrent run never loads a partial object. Every writer gets a file
+		// of its own, otherwise two runs storing the same key could interleave their writes.
+		auto path = get_path(key);
+		llvm::SmallString<128> temporary_path;
+		int fd;
+		if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%%%.tmp", fd, temporary_path))
+			return;
+
+		{
+			llvm::raw_fd_ostream out(fd, true);
+			out << object.getBuffer();
+			out.close();
+
+			// A failed write, e.g. on a full disk, leaves a truncated object. The error has to be cleared or the
+			// stream aborts the process when it is destroyed.
+			if (out.has_error())
+			{
+				out.clear_error();
+				llvm::sys::fs::remove(temporary_path);
+				return;
+			}
+		}
+
+		if (llvm::sys::fs::rename(temporary_path, path))
+			llvm::sys::fs::remove(temporary_path);
+	}
+
+	std::unique_ptr<llvm::MemoryBuffer> ObjectCache::getObject(const llvm::Module* module)
+	{
+		std::string key;
+		if (!get_key_from_module(module, key))
+			return nullptr;
+
+		return load(key);
+	}
+
+	std::string ObjectCache::get_path(const std::string& key) const
+	{
+		llvm::SmallString<128> path(directory_);
+		llvm::sys::path::append(path, key + ".o");
+		return path.str().str();
+	}
+
+	bool ObjectCache::get_key_from_module(const llvm::Module* module, std::string& key)
+	{
+		// Only whole modules named by get_module_identifier are cached, not the partitions of the lazy layer
+		llvm::StringRef identifier = module->getModuleIdentifier();
+		if (!identifier.startswith(module_prefix) || identifier.size() != sizeof(module_prefix) - 1 + 32)
+			return false;
+
+		key = identifier.substr(sizeof(module_prefix) - 1).str();
+		return true;
+	}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "codegen.h"
+
+namespace tiny {
+
+	// Stores compiled objects as <directory>/<key>.o. The key covers everything that changes the machine code: the
+	// source text, the CodeGen options, the target triple, the CPU and its features.
+	class ObjectCache : public llvm::ObjectCache
+	{
+	public:
+		ObjectCache(std::string directory);
+
+		static std::string get_key(llvm::StringRef source, OptLevel level, bool batch_functions, const llvm::TargetMachine& tm);
+		// A module named like this is stored under key when the compile layer emits it
+		static std::string get_module_identifier(const std::string& key);
+
+		// The cached object for key or nullptr
+		std::unique_ptr<llvm::MemoryBuffer> load(const std::string& key) const;
+		// Drops an entry that turned out to be unusable, so the next run compiles and stores it again
+		void remove(const std::string& key) const;
+
+		void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+		std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+
+	private:
+		std::string get_path(const std::string& key) const;
+		static bool get_key_from_module(const llvm::Module* module, std::string& key);
+
+		std::string directory_;
+	};
+
+}
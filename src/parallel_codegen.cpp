@@ -0,0 +1,68 @@
+#include "parallel_codegen.h"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "flat_ast.h"
+
+namespace tiny {
+
+	static CompiledObject compile_partition(const FlatAST& ast, OptLevel level, bool batch_functions, u32 partition, u32 partition_count)
+	{
+		// The compiler keeps state in the TargetMachine, so it can not be shared between threads
+		std::unique_ptr<llvm::TargetMachine> tm(llvm::EngineBuilder().setOptLevel(get_codegen_opt_level(level)).selectTarget());
+		llvm::LLVMContext context;
+
+		CodeGen codegen(context, tm.get(), level);
+		codegen.set_batch_functions(batch_functions);
+		auto module = codegen.execute(ast, partition, partition_count);
+
+		// The object owns copies of everything it needs, so the context can go away with this function
+		return llvm::orc::SimpleCompiler(*tm)(*module);
+	}
+
+	std::vector<CompiledObject> compile_parallel(AST* ast, OptLevel level, u32 thread_count, bool batch_functions)
+	{
+		auto partition_count = std::max(1u, std::min(thread_count, ast->function_count));
+
+		// Flattened once up front, every thread only reads it
+		auto flat = flatten(ast);
+
+		std::vector<CompiledObject> objects(partition_count);
+		std::vector<std::exception_ptr> errors(partition_count);
+
+		std::vector<std::thread> threads;
+		for (u32 i = 0; i < partition_count; i++)
+		{
+			threads.push_back(std::thread([=, &flat, &objects, &errors]() {
+				try
+				{
+					objects[i] = compile_partition(flat, level, batch_functions, i, partition_count);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			}));
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		for (auto& error : errors)
+		{
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		return objects;
+	}
+
+}
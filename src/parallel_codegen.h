@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+#include "llvm/Object/ObjectFile.h"
+
+#include "ast.h"
+#include "codegen.h"
+
+namespace tiny {
+
+	typedef llvm::object::OwningBinary<llvm::object::ObjectFile> CompiledObject;
+
+	// Generates and compiles the functions of ast on up to thread_count threads. Each thread owns an LLVMContext, a
+	// TargetMachine and a module that declares every function but only holds the bodies of every thread_count-th
+	// one. The objects reference each other's functions, so they have to be linked together, e.g. with
+	// OrcJit::add_object. The AST is only read and can not be modified while this runs.
+	std::vector<CompiledObject> compile_parallel(AST* ast, OptLevel level, u32 thread_count, bool batch_functions = false);
+
+}
@@ -7,37 +7,34 @@
 
 namespace tiny {
 
-	Parser::Parser(std::unique_ptr<Lexer> lexer) : lexer_(std::move(lexer))
+	Parser::Parser(std::unique_ptr<Lexer> lexer) : lexer_(std::move(lexer)), tokens_(lexer_->tokenize()), index_(0), ast_(nullptr), current_function_(nullptr), grammar_(get_grammar())
 	{
-		current_token_ = lexer_->next();
-		initialize_grammar();
 	}
 
 	std::unique_ptr<AST> Parser::parse()
 	{
-		auto ast = std::make_unique<AST>();
+		auto ast = std::make_unique<AST>(lexer_->interner());
+		ast_ = ast.get();
 
-		push_scope(ast->symbol_table_.get());
-
-		while (current_token_->type != TokenType::Eof)
+		while (current_type() != TokenType::Eof)
 		{
 			ast->nodes.push_back(parse_global());
 		}
 
-		pop_scope();
+		ast_ = nullptr;
 
 		throw_if_has_errors();
 
 		return ast;
 	}
 
-	std::unique_ptr<ASTNode> Parser::parse_global()
+	ASTNode* Parser::parse_global()
 	{
-		auto parser = get_global_ll2_parser(current_token_->type, peek()->type);
+		auto parser = get_global_ll2_parser(current_type(), peek_type());
 
 		if (parser == nullptr)
 		{
-			parser = get_global_parser(current_token_->type);
+			parser = get_global_parser(current_type());
 			if (parser == nullptr)
 				throw_unexpected_token();
 		}
@@ -45,30 +42,30 @@ namespace tiny {
 		return parser(this);
 	}
 
-	std::unique_ptr<ASTNode> Parser::parse_expression()
+	ASTNode* Parser::parse_expression()
 	{
 		return parse_expression(0);
 	}
 
-	std::unique_ptr<ASTNode> Parser::parse_expression(u16 precedence)
+	ASTNode* Parser::parse_expression(u16 precedence)
 	{
-		auto parser = get_ll2_parser(current_token_->type, peek()->type);
+		auto parser = get_ll2_parser(current_type(), peek_type());
 
 		if (parser == nullptr)
 		{
-			parser = get_parser(current_token_->type);
+			parser = get_parser(current_type());
 			if (parser == nullptr)
 				throw_unexpected_token();
 		}
 
 		auto left = parser(this);
-		while (precedence < get_operator_precedence(current_token_->type))
+		while (precedence < get_operator_precedence(current_type()))
 		{
-			auto infix_parser = get_infix_parser(current_token_->type);
+			auto infix_parser = get_infix_parser(current_type());
 			if (infix_parser == nullptr)
 				throw_unexpected_token();
 
-			left = infix_parser(this, std::move(left));
+			left = infix_parser(this, left);
 		}
 
 		return left;
@@ -76,20 +73,22 @@ namespace tiny {
 
 	void Parser::consume(TokenType type)
 	{
-		if (current_token_->type != type)
+		if (current_type() != type)
 			throw_unexpected_token();
 
-		current_token_ = lexer_->next();
+		consume();
 	}
 
 	void Parser::consume()
 	{
-		current_token_ = lexer_->next();
+		// The stream always ends with Eof, stay on it instead of running off the end
+		if (index_ + 1 < tokens_.size())
+			index_++;
 	}
 
 	bool Parser::consume_ptr()
 	{
-		if(current_token_->type == TokenType::Star)
+		if(current_type() == TokenType::Star)
 		{
 			consume(TokenType::Star);
 			return true;
@@ -98,14 +97,32 @@ namespace tiny {
 		return false;
 	}
 
-	const Token* Parser::current() const
+	TokenType Parser::current_type() const
+	{
+		return tokens_.kinds[index_];
+	}
+
+	llvm::StringRef Parser::current_value() const
 	{
-		return current_token_.get();
+		return tokens_.value(index_);
 	}
 
-	const Token* Parser::peek() const
+	SymbolId Parser::current_symbol() const
 	{
-		return lexer_->peek();
+		return tokens_.symbols[index_];
+	}
+
+	u32 Parser::current_line() const
+	{
+		return tokens_.line_number(index_);
+	}
+
+	TokenType Parser::peek_type() const
+	{
+		if (index_ + 1 < tokens_.size())
+			return tokens_.kinds[index_ + 1];
+
+		return TokenType::Eof;
 	}
 
 	void Parser::register_error(const std::string& msg)
@@ -118,19 +135,49 @@ namespace tiny {
 		}
 	}
 
-	void Parser::push_scope(SymbolTable<TinyType>* scope)
+	void Parser::push_scope()
 	{
-		scopes_.push(scope);
+		symbols_.push_scope();
 	}
 
 	void Parser::pop_scope()
 	{
-		scopes_.pop();
+		symbols_.pop_scope();
+	}
+
+	SymbolTable<ParserSymbol>& Parser::symbols()
+	{
+		return symbols_;
+	}
+
+	FnDeclaration* Parser::current_function() const
+	{
+		return current_function_;
+	}
+
+	void Parser::set_current_function(FnDeclaration* fn)
+	{
+		current_function_ = fn;
+	}
+
+	u32 Parser::allocate_function_index()
+	{
+		return ast_->function_count++;
+	}
+
+	Interner* Parser::interner() const
+	{
+		return lexer_->interner();
 	}
 
-	SymbolTable<TinyType>* Parser::current_scope()
+	Arena& Parser::arena()
 	{
-		return scopes_.top();
+		return ast_->arena;
+	}
+
+	const TinyType* Parser::get_type(Type type)
+	{
+		return ast_->types.get(type);
 	}
 
 	void Parser::throw_if_has_errors() const
@@ -150,117 +197,98 @@ namespace tiny {
 
 	void Parser::throw_unexpected_token() const
 	{
-		throw TinyException("Unexpected token, Line: " + std::to_string(current_token_->line_number) + " Column: " + std::to_string(current_token_->start_column));
+		throw TinyException("Unexpected token, File: " + lexer_->get_file_name(tokens_.file_id) + " Line: " + std::to_string(current_line()) + " Column: " + std::to_string(tokens_.column(index_)));
 	}
 
-	void Parser::register_global_parser(TokenType type, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler)
+	void Parser::register_global_parser(Grammar& grammar, TokenType type, ParseFn handler)
 	{
-		global_parsers_.insert(std::make_pair(type, handler));
+		grammar.global_parsers[static_cast<u16>(type)] = handler;
 	}
 
-	void Parser::register_parser(TokenType type, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler)
+	void Parser::register_parser(Grammar& grammar, TokenType type, ParseFn handler)
 	{
-		parsers_.insert(std::make_pair(type, handler));
+		grammar.parsers[static_cast<u16>(type)] = handler;
 	}
 
-	void Parser::register_ll2_parser(TokenType t1, TokenType t2, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler)
+	void Parser::register_ll2_parser(Grammar& grammar, TokenType t1, TokenType t2, ParseFn handler)
 	{
-		ll2_parsers_.push_back(LL2ParserEntry{ t1, t2, handler });
+		grammar.ll2_parsers[static_cast<u16>(t1)][static_cast<u16>(t2)] = handler;
 	}
 
-	void Parser::register_global_ll2_parser(TokenType t1, TokenType t2, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler)
+	void Parser::register_global_ll2_parser(Grammar& grammar, TokenType t1, TokenType t2, ParseFn handler)
 	{
-		global_ll2_parsers_.push_back(LL2ParserEntry{ t1, t2, handler });
+		grammar.global_ll2_parsers[static_cast<u16>(t1)][static_cast<u16>(t2)] = handler;
 	}
 
-	void Parser::register_infix_parser(TokenType type, std::function<std::unique_ptr<ASTNode>(Parser* parser, std::unique_ptr<ASTNode> left)> handler)
+	void Parser::register_infix_parser(Grammar& grammar, TokenType type, InfixParseFn handler)
 	{
-		infix_parsers_.insert(std::make_pair(type, handler));
+		grammar.infix_parsers[static_cast<u16>(type)] = handler;
 	}
 
-	std::function<std::unique_ptr<ASTNode>(Parser*)> Parser::get_global_parser(TokenType type)
+	ParseFn Parser::get_global_parser(TokenType type) const
 	{
-		auto it = global_parsers_.find(type);
-		if (it != global_parsers_.end())
-		{
-			return it->second;
-		}
-
-		return nullptr;
+		return grammar_.global_parsers[static_cast<u16>(type)];
 	}
 
-	std::function<std::unique_ptr<ASTNode>(Parser*)> Parser::get_global_ll2_parser(TokenType t1, TokenType t2)
+	ParseFn Parser::get_global_ll2_parser(TokenType t1, TokenType t2) const
 	{
-		for (auto& e : global_ll2_parsers_)
-		{
-			if (e.t1 == t1 && e.t2 == t2)
-				return e.parser;
-		}
-
-		return nullptr;
+		return grammar_.global_ll2_parsers[static_cast<u16>(t1)][static_cast<u16>(t2)];
 	}
 
-	std::function<std::unique_ptr<ASTNode>(Parser*)> Parser::get_parser(TokenType type)
+	ParseFn Parser::get_parser(TokenType type) const
 	{
-		auto it = parsers_.find(type);
-		if (it != parsers_.end())
-		{
-			return it->second;
-		}
-
-		return nullptr;
+		return grammar_.parsers[static_cast<u16>(type)];
 	}
 
-	std::function<std::unique_ptr<ASTNode>(Parser*)> Parser::get_ll2_parser(TokenType t1, TokenType t2)
+	ParseFn Parser::get_ll2_parser(TokenType t1, TokenType t2) const
 	{
-		for(auto& e : ll2_parsers_)
-		{
-			if (e.t1 == t1 && e.t2 == t2)
-				return e.parser;
-		}
+		return grammar_.ll2_parsers[static_cast<u16>(t1)][static_cast<u16>(t2)];
+	}
 
-		return nullptr;
+	InfixParseFn Parser::get_infix_parser(TokenType type) const
+	{
+		return grammar_.infix_parsers[static_cast<u16>(type)];
 	}
 
-	std::function<std::unique_ptr<ASTNode>(Parser*, std::unique_ptr<ASTNode>)> Parser::get_infix_parser(TokenType type)
+	const Grammar& Parser::get_grammar()
 	{
-		auto it = infix_parsers_.find(type);
-		if (it != infix_parsers_.end())
+		// The grammar is the same for every Parser so the tables are only built once per process
+		static const Grammar grammar = []()
 		{
-			return it->second;
-		}
+			Grammar g = {};
+			initialize_grammar(g);
+			return g;
+		}();
 
-		return nullptr;
+		return grammar;
 	}
 
-	
-
-	void Parser::initialize_grammar()
+	void Parser::initialize_grammar(Grammar& grammar)
 	{
 		// Global parsers
-		register_global_parser(TokenType::Fn, parse_fn_declaration);
-		register_global_parser(TokenType::Ext, parse_fn_declaration);
+		register_global_parser(grammar, TokenType::Fn, parse_fn_declaration);
+		register_global_parser(grammar, TokenType::Ext, parse_fn_declaration);
 
 		// Global LL2 parsers
-		//register_global_ll2_parser(TokenType::Id, TokenType::ShortDec, parse_short_dec);
+		//register_global_ll2_parser(grammar, TokenType::Id, TokenType::ShortDec, parse_short_dec);
 
 		// LL2 parsers
-		register_ll2_parser(TokenType::Id, TokenType::ShortDec, parse_short_dec);
-		register_ll2_parser(TokenType::Id, TokenType::LParen, parse_call);
+		register_ll2_parser(grammar, TokenType::Id, TokenType::ShortDec, parse_short_dec);
+		register_ll2_parser(grammar, TokenType::Id, TokenType::LParen, parse_call);
 
 		// Parsers
-		register_parser(TokenType::LParen, parse_grouped_expression);
-		register_parser(TokenType::Id, parse_id);
-		register_parser(TokenType::IntLiteral, parse_literal);
-		register_parser(TokenType::StringLiteral, parse_literal);
-		register_parser(TokenType::Ret, parse_ret_dec);
+		register_parser(grammar, TokenType::LParen, parse_grouped_expression);
+		register_parser(grammar, TokenType::Id, parse_id);
+		register_parser(grammar, TokenType::IntLiteral, parse_literal);
+		register_parser(grammar, TokenType::StringLiteral, parse_literal);
+		register_parser(grammar, TokenType::Ret, parse_ret_dec);
 
 		// Infix parsers
-		register_infix_parser(TokenType::Assign, parse_binary_operator);
-		register_infix_parser(TokenType::ShortDec, parse_binary_operator);
-		register_infix_parser(TokenType::Plus, parse_binary_operator);
-		register_infix_parser(TokenType::Minus, parse_binary_operator);
-		register_infix_parser(TokenType::Star, parse_binary_operator);
-		register_infix_parser(TokenType::Divide, parse_binary_operator);
+		register_infix_parser(grammar, TokenType::Assign, parse_binary_operator);
+		register_infix_parser(grammar, TokenType::ShortDec, parse_binary_operator);
+		register_infix_parser(grammar, TokenType::Plus, parse_binary_operator);
+		register_infix_parser(grammar, TokenType::Minus, parse_binary_operator);
+		register_infix_parser(grammar, TokenType::Star, parse_binary_operator);
+		register_infix_parser(grammar, TokenType::Divide, parse_binary_operator);
 	}
 }
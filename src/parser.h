@@ -1,24 +1,36 @@
 #pragma once
 
 #include <memory>
-#include <functional>
-#include <unordered_map>
 #include <vector>
-#include <stack>
 
 #include "type.h"
 #include "lexer.h"
 #include "ast.h"
+#include "symbols.h"
 
 namespace tiny {
 
 	class Parser;
 
-	struct LL2ParserEntry
+	typedef ASTNode*(*ParseFn)(Parser* parser);
+	typedef ASTNode*(*InfixParseFn)(Parser* parser, ASTNode* left);
+
+	// Dispatch tables indexed by TokenType, unregistered entries are nullptr
+	struct Grammar
 	{
-		TokenType t1;
-		TokenType t2;
-		std::function<std::unique_ptr<ASTNode>(Parser*)> parser;
+		ParseFn global_parsers[token_type_count];
+		ParseFn global_ll2_parsers[token_type_count][token_type_count];
+		ParseFn parsers[token_type_count];
+		ParseFn ll2_parsers[token_type_count][token_type_count];
+		InfixParseFn infix_parsers[token_type_count];
+	};
+
+	// What a name resolves to, index is a local slot of the current function or a function index if function is set
+	struct ParserSymbol
+	{
+		const TinyType* type;
+		u32 index;
+		bool function;
 	};
 
 	class Parser
@@ -26,44 +38,60 @@ namespace tiny {
 	public:
 		Parser(std::unique_ptr<Lexer> lexer);
 		std::unique_ptr<AST> parse();
-		std::unique_ptr<ASTNode> parse_global();
-		std::unique_ptr<ASTNode> parse_expression();
-		std::unique_ptr<ASTNode> parse_expression(u16 precedence);
+		ASTNode* parse_global();
+		ASTNode* parse_expression();
+		ASTNode* parse_expression(u16 precedence);
 		void consume(TokenType type);
 		void consume();
 		bool consume_ptr();
-		const Token* current() const;
-		const Token* peek() const;
+		TokenType current_type() const;
+		llvm::StringRef current_value() const;
+		SymbolId current_symbol() const;
+		u32 current_line() const;
+		TokenType peek_type() const;
 		void register_error(const std::string& msg);
-		void push_scope(SymbolTable<TinyType>* scope);
+		void push_scope();
 		void pop_scope();
-		SymbolTable<TinyType>* current_scope();
+		SymbolTable<ParserSymbol>& symbols();
+		FnDeclaration* current_function() const;
+		void set_current_function(FnDeclaration* fn);
+		u32 allocate_function_index();
+		Interner* interner() const;
+		Arena& arena();
+		const TinyType* get_type(Type type);
+
+		// Allocates a node in the arena of the AST being parsed
+		template<class T, class... TArgs>
+		T* create(TArgs&&... args)
+		{
+			return arena().create<T>(std::forward<TArgs>(args)...);
+		}
 
 	private:
 		void throw_if_has_errors() const;
 		void throw_unexpected_token() const;
 
-		void register_global_parser(TokenType type, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler);
-		void register_parser(TokenType type, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler);
-		void register_ll2_parser(TokenType t1, TokenType t2, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler);
-		void register_global_ll2_parser(TokenType t1, TokenType t2, std::function<std::unique_ptr<ASTNode>(Parser* parser)> handler);
-		void register_infix_parser(TokenType type, std::function<std::unique_ptr<ASTNode>(Parser* parser, std::unique_ptr<ASTNode> left)> handler);
-		std::function<std::unique_ptr<ASTNode>(Parser*)> get_global_parser(TokenType type);
-		std::function<std::unique_ptr<ASTNode>(Parser*)> get_global_ll2_parser(TokenType t1, TokenType t2);
-		std::function<std::unique_ptr<ASTNode>(Parser*)> get_parser(TokenType type);
-		std::function<std::unique_ptr<ASTNode>(Parser*)> get_ll2_parser(TokenType t1, TokenType t2);
-		std::function<std::unique_ptr<ASTNode>(Parser*, std::unique_ptr<ASTNode>)> get_infix_parser(TokenType type);
+		static void register_global_parser(Grammar& grammar, TokenType type, ParseFn handler);
+		static void register_parser(Grammar& grammar, TokenType type, ParseFn handler);
+		static void register_ll2_parser(Grammar& grammar, TokenType t1, TokenType t2, ParseFn handler);
+		static void register_global_ll2_parser(Grammar& grammar, TokenType t1, TokenType t2, ParseFn handler);
+		static void register_infix_parser(Grammar& grammar, TokenType type, InfixParseFn handler);
+		ParseFn get_global_parser(TokenType type) const;
+		ParseFn get_global_ll2_parser(TokenType t1, TokenType t2) const;
+		ParseFn get_parser(TokenType type) const;
+		ParseFn get_ll2_parser(TokenType t1, TokenType t2) const;
+		InfixParseFn get_infix_parser(TokenType type) const;
 
-		void initialize_grammar();
+		static const Grammar& get_grammar();
+		static void initialize_grammar(Grammar& grammar);
 
-		std::unique_ptr<Token> current_token_;
 		std::unique_ptr<Lexer> lexer_;
-		std::stack<SymbolTable<TinyType>*> scopes_;
-		std::unordered_map<TokenType, std::function<std::unique_ptr<ASTNode>(Parser*)>> global_parsers_;
-		std::vector<LL2ParserEntry> global_ll2_parsers_;
-		std::unordered_map<TokenType, std::function<std::unique_ptr<ASTNode>(Parser*)>> parsers_;
-		std::vector<LL2ParserEntry> ll2_parsers_;
-		std::unordered_map<TokenType, std::function<std::unique_ptr<ASTNode>(Parser*, std::unique_ptr<ASTNode>)>> infix_parsers_;
+		TokenStream tokens_;
+		u32 index_;
+		AST* ast_;
+		SymbolTable<ParserSymbol> symbols_;
+		FnDeclaration* current_function_;
+		const Grammar& grammar_;
 		std::vector<std::string> errors_;
 	};
 }
@@ -1,3 +1,5 @@
+#include "llvm/ADT/SmallVector.h"
+
 #include "ast.h"
 #include "token.h"
 #include "parser.h"
@@ -6,121 +8,140 @@
 
 namespace tiny {
 
-	std::unique_ptr<ASTNode> parse_fn_declaration(Parser* parser)
+	ASTNode* parse_fn_declaration(Parser* parser)
 	{
 		bool ext = false;
-		if(parser->current()->type == TokenType::Ext)
+		if(parser->current_type() == TokenType::Ext)
 		{
 			ext = true;
 			parser->consume(TokenType::Ext);
 		}
 
-		auto fn = std::make_unique<FnDeclaration>(parser->current_scope(), ext);
-		parser->push_scope(fn->symbol_table_.get());
+		auto fn = parser->create<FnDeclaration>(parser->get_type(Type::Fn), ext);
+		parser->push_scope();
+		parser->set_current_function(fn);
 		parser->consume(TokenType::Fn);
 
-		auto name = parser->current()->value;
+		auto name = parser->current_symbol();
 		parser->consume(TokenType::Id);
 		fn->name = name;
 
 		parser->consume(TokenType::LParen);
 
-		while (parser->current()->type != TokenType::RParen)
+		llvm::SmallVector<ArgDeclaration*, 4> args;
+		while (parser->current_type() != TokenType::RParen)
 		{
-			auto arg_name = parser->current()->value;
+			auto arg_name = parser->current_symbol();
 			parser->consume(TokenType::Id);
-			auto arg_type_token = parser->current()->type;
+			auto arg_type_token = parser->current_type();
 			parser->consume();
 
 			auto pointer = parser->consume_ptr();
-			auto arg_type = get_type_from_token(arg_type_token, pointer);
+			auto arg_type = parser->get_type(get_type_from_token(arg_type_token, pointer));
 
-			if (parser->current_scope()->has_entry(arg_name))
-				parser->register_error("An argument with the name '" + arg_name + "' already exists in the current scope, Line: " + std::to_string(parser->current()->line_number));
+			auto slot = fn->local_count++;
+			if (parser->symbols().get_entry(arg_name) != nullptr)
+				parser->register_error("An argument with the name '" + parser->interner()->get(arg_name).str() + "' already exists in the current scope, Line: " + std::to_string(parser->current_line()));
 			else
-				parser->current_scope()->add_entry(arg_name, std::make_unique<TinyType>(arg_type->type));
+				parser->symbols().add_entry(arg_name, ParserSymbol{ arg_type, slot, false });
 			
-			fn->args.push_back(std::make_unique<ArgDeclaration>(arg_name, std::move(arg_type)));
+			args.push_back(parser->create<ArgDeclaration>(arg_name, arg_type, slot));
 
-			if(parser->current()->type == TokenType::Comma)
+			if(parser->current_type() == TokenType::Comma)
 				parser->consume(TokenType::Comma);
 		}
 
+		fn->args = parser->arena().copy<ArgDeclaration*>(args);
+
 		parser->consume(TokenType::RParen);
 		parser->consume(TokenType::RArrow);
 
-		auto return_type_token = parser->current()->type;
+		auto return_type_token = parser->current_type();
 		parser->consume();
 
 		auto pointer = parser->consume_ptr();
-		fn->return_type = get_type_from_token(return_type_token, pointer);
+		fn->return_type = parser->get_type(get_type_from_token(return_type_token, pointer));
 
-		parser->current_scope()->add_root_entry(name, std::make_unique<TinyType>(fn->return_type->type));
+		fn->index = parser->allocate_function_index();
+		if (parser->symbols().get_root_entry(name) != nullptr)
+			parser->register_error("A function with the name '" + parser->interner()->get(name).str() + "' has already been declared, Line: " + std::to_string(parser->current_line()));
+		else
+			parser->symbols().add_root_entry(name, ParserSymbol{ fn->return_type, fn->index, true });
 
 		if(ext)
-			return std::move(fn);
+		{
+			parser->set_current_function(nullptr);
+			parser->pop_scope();
+			return fn;
+		}
 
 		parser->consume(TokenType::LBracket);
 
-		while (parser->current()->type != TokenType::RBracket)
+		llvm::SmallVector<ASTNode*, 16> body;
+		while (parser->current_type() != TokenType::RBracket)
 		{
-			fn->body.push_back(parser->parse_expression());
+			body.push_back(parser->parse_expression());
 		}
 
+		fn->body = parser->arena().copy<ASTNode*>(body);
+
 		parser->consume(TokenType::RBracket);
 
+		parser->set_current_function(nullptr);
 		parser->pop_scope();
 
-		return std::move(fn);
+		return fn;
 	}
 
-	std::unique_ptr<ASTNode> parse_id(Parser* parser)
+	ASTNode* parse_id(Parser* parser)
 	{
-		auto name = parser->current()->value;
+		auto name = parser->current_symbol();
 		parser->consume(TokenType::Id);
 
-		if (parser->current_scope()->has_entry(name))
-		{
-			auto entry = parser->current_scope()->get_entry(name);
-			return std::make_unique<Identifier>(name, std::make_unique<TinyType>(entry->value->type));
-		}
+		auto entry = parser->symbols().get_entry(name);
+		if (entry != nullptr && !entry->value.function)
+			return parser->create<Identifier>(name, entry->value.type, entry->value.index);
 
-		parser->register_error("Unknown identifier '" + name + "', line: " + std::to_string(parser->current()->line_number));
-		return std::make_unique<Identifier>(name, std::make_unique<TinyType>(Type::Unresolved));
+		parser->register_error("Unknown identifier '" + parser->interner()->get(name).str() + "', line: " + std::to_string(parser->current_line()));
+		return parser->create<Identifier>(name, parser->get_type(Type::Unresolved), unresolved_index);
 	}
 
-	std::unique_ptr<ASTNode> parse_literal(Parser* parser)
+	ASTNode* parse_literal(Parser* parser)
 	{
-		auto value = parser->current()->value;
-		switch (parser->current()->type)
+		auto value = parser->current_value();
+		switch (parser->current_type())
 		{
 		case TokenType::IntLiteral: {
+			i32 v = 0;
+			if (value.getAsInteger(10, v))
+				parser->register_error("Integer literal '" + value.str() + "' is out of range, line: " + std::to_string(parser->current_line()));
+
 			parser->consume(TokenType::IntLiteral);
-			return std::make_unique<IntLiteral>(std::stoi(value));
+			return parser->create<IntLiteral>(parser->get_type(Type::I32), v);
 		}
 		case TokenType::StringLiteral: {
 			parser->consume(TokenType::StringLiteral);
-			return std::make_unique<StringLiteral>(value);
+			return parser->create<StringLiteral>(parser->get_type(Type::I8Ptr), parser->arena().copy(value));
 		}
 		default:
 			throw TinyException("Unexpected literal -> parse_literal");
 		}
 	}
 
-	std::unique_ptr<ASTNode> parse_binary_operator(Parser* parser, std::unique_ptr<ASTNode> left)
+	ASTNode* parse_binary_operator(Parser* parser, ASTNode* left)
 	{
-		auto op = parser->current()->type;
+		auto op = parser->current_type();
 		parser->consume();
 
 		auto right = parser->parse_expression(get_operator_precedence(op));
 
-		if (!left->type->are_equal(right->type.get()))
-			parser->register_error("Type mismatch at line: " + std::to_string(parser->current()->line_number));
+		if (!left->type->are_equal(right->type))
+			parser->register_error("Type mismatch at line: " + std::to_string(parser->current_line()));
 
-		return std::make_unique<BinaryOperator>(op, std::move(left), std::move(right));
+		return parser->create<BinaryOperator>(op, left, right);
 	}
 
-	std::unique_ptr<ASTNode> parse_grouped_expression(Parser* parser)
+	ASTNode* parse_grouped_expression(Parser* parser)
 	{
 		parser->consume(TokenType::LParen);
 		auto expression = parser->parse_expression();
@@ -128,80 +149,89 @@ namespace tiny {
 		return expression;
 	}
 
-	std::unique_ptr<ASTNode> parse_dec(Parser* parser, const std::string& name, std::unique_ptr<TinyType> type, std::unique_ptr<ASTNode> exp, bool pointer = false)
+	ASTNode* parse_dec(Parser* parser, SymbolId name, const TinyType* type, ASTNode* exp, bool pointer = false)
 	{
-		if (parser->current_scope()->has_entry(name))
-			parser->register_error("An identifier with the name '" + name + "' already exists in the current scope, Line: " + std::to_string(parser->current()->line_number));
+		auto slot = parser->current_function()->local_count++;
+		if (parser->symbols().get_entry(name) != nullptr)
+			parser->register_error("An identifier with the name '" + parser->interner()->get(name).str() + "' already exists in the current scope, Line: " + std::to_string(parser->current_line()));
 		else
-			parser->current_scope()->add_entry(name, std::make_unique<TinyType>(exp->type->type));
+			parser->symbols().add_entry(name, ParserSymbol{ exp->type, slot, false });
 
-		return std::make_unique<VarDeclaration>(name, std::move(exp), std::move(type), pointer);
+		return parser->create<VarDeclaration>(name, exp, type, pointer, slot);
 	}
 
-	std::unique_ptr<ASTNode> parse_short_dec(Parser* parser)
+	ASTNode* parse_short_dec(Parser* parser)
 	{
-		auto name = parser->current()->value;
+		auto name = parser->current_symbol();
 		parser->consume(TokenType::Id);
 		parser->consume(TokenType::ShortDec);
 
 		auto exp = parser->parse_expression();
-		auto type = exp->type->type;
 
-		return parse_dec(parser, name, std::make_unique<TinyType>(type), std::move(exp));
+		return parse_dec(parser, name, exp->type, exp);
 	}
 
-	std::unique_ptr<ASTNode> parse_explicit_dec(Parser* parser)
+	ASTNode* parse_explicit_dec(Parser* parser)
 	{
-		auto type_token = parser->current()->type;
+		auto type_token = parser->current_type();
 		parser->consume();
 		
 		auto pointer = parser->consume_ptr();
 
-		auto type = get_type_from_token(type_token, pointer);
+		auto type = parser->get_type(get_type_from_token(type_token, pointer));
 
-		auto name = parser->current()->value;
+		auto name = parser->current_symbol();
 		parser->consume(TokenType::Id);
 		parser->consume(TokenType::Assign);
 
 		auto exp = parser->parse_expression();
 
-		return  parse_dec(parser, name, std::move(type), std::move(exp), pointer);
+		return  parse_dec(parser, name, type, exp, pointer);
 	}
 
-	std::unique_ptr<ASTNode> parse_ret_dec(Parser* parser)
+	ASTNode* parse_ret_dec(Parser* parser)
 	{
 		parser->consume(TokenType::Ret);
-		return std::make_unique<RetDeclaration>(parser->parse_expression());
+		return parser->create<RetDeclaration>(parser->parse_expression());
 	}
 
-	std::unique_ptr<ASTNode> parse_call(Parser* parser)
+	ASTNode* parse_call(Parser* parser)
 	{
-		auto name = parser->current()->value;
+		auto name = parser->current_symbol();
 
 		parser->consume(TokenType::Id);
 		parser->consume(TokenType::LParen);
 
-		auto return_type = std::make_unique<TinyType>(Type::Unresolved);
+		auto return_type = parser->get_type(Type::Unresolved);
+		auto index = unresolved_index;
 
-		auto fn = parser->current_scope()->get_entry(name);
-		if (fn == nullptr)
-			parser->register_error("The function '" + name + "' has not been defined, Line: " + std::to_string(parser->current()->line_number));
+		auto fn = parser->symbols().get_entry(name);
+		if (fn == nullptr || !fn->value.function)
+		{
+			parser->register_error("The function '" + parser->interner()->get(name).str() + "' has not been defined, Line: " + std::to_string(parser->current_line()));
+		}
 		else
-			return_type = std::make_unique<TinyType>(fn->value->type);
+		{
+			return_type = fn->value.type;
+			index = fn->value.index;
+		}
 
-		auto exp = std::make_unique<CallExp>(name, std::move(return_type));
+		auto exp = parser->create<CallExp>(name, return_type, index);
 
-		while(parser->current()->type != TokenType::RParen)
+		llvm::SmallVector<ASTNode*, 8> args;
+		while(parser->current_type() != TokenType::RParen)
 		{
-			exp->args.push_back(parser->parse_expression());
+			args.push_back(parser->parse_expression());
 			
-			if (parser->current()->type == TokenType::Comma)
+			if (parser->current_type() == TokenType::Comma)
 				parser->consume(TokenType::Comma);
 		}
 
+		exp->args = parser->arena().copy<ASTNode*>(args);
+
 		parser->consume(TokenType::RParen);
 
-		return std::move(exp);
+		return exp;
 	}
 
-}
\ No newline at end of file
+}
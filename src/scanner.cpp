@@ -0,0 +1,206 @@
+#include "scanner.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MathExtras.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TINY_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+// MSVC allows AVX2 intrinsics anywhere, gcc and clang need the functions using them to be marked
+#if defined(TINY_SCANNER_X86) && !defined(_MSC_VER)
+#define TINY_TARGET_SSE2 __attribute__((target("sse2")))
+#define TINY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TINY_TARGET_SSE2
+#define TINY_TARGET_AVX2
+#endif
+
+namespace tiny {
+
+	enum CharClass : u8
+	{
+		Identifier = 1,
+		Digit = 2,
+		Whitespace = 4,
+		StringBody = 8
+	};
+
+	struct CharClassTable
+	{
+		CharClassTable()
+		{
+			for (auto c = 0; c < 256; c++)
+			{
+				u8 classes = 0;
+
+				if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')
+					classes |= Identifier;
+
+				if (c >= '0' && c <= '9')
+					classes |= Digit;
+
+				if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f')
+					classes |= Whitespace;
+
+				if (c != '"' && c != '\0')
+					classes |= StringBody;
+
+				entries[c] = classes;
+			}
+		}
+
+		u8 entries[256];
+	};
+
+	static const CharClassTable char_classes;
+
+	template<u8 TClass>
+	static u32 scan_scalar(const char* p)
+	{
+		auto start = p;
+		while (char_classes.entries[static_cast<u8>(*p)] & TClass)
+			p++;
+
+		return static_cast<u32>(p - start);
+	}
+
+#ifdef TINY_SCANNER_X86
+
+	// The vectorized scanners only use aligned loads. An aligned block never straddles a page boundary, so reading
+	// the whole block that holds the sentinel can not fault even though it may read a few bytes past the buffer.
+
+	// 0xFF for every byte of v in [lo, hi], computed with a signed compare after shifting lo down to -128
+	TINY_TARGET_SSE2 static inline __m128i in_range_sse2(__m128i v, char lo, char hi)
+	{
+		auto shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - lo)));
+		return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + (hi - lo) + 1)));
+	}
+
+	template<u8 TClass>
+	TINY_TARGET_SSE2 static inline __m128i classify_sse2(__m128i v)
+	{
+		switch (TClass)
+		{
+		case Identifier: {
+			auto alpha = in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+			auto digit = in_range_sse2(v, '0', '9');
+			auto underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+			return _mm_or_si128(_mm_or_si128(alpha, digit), underscore);
+		}
+		case Digit:
+			return in_range_sse2(v, '0', '9');
+		case Whitespace: {
+			auto space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+			auto control = in_range_sse2(v, '\t', '\r');
+			auto new_line = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+			return _mm_or_si128(space, _mm_andnot_si128(new_line, control));
+		}
+		default: {
+			auto quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+			auto sentinel = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+			return _mm_xor_si128(_mm_or_si128(quote, sentinel), _mm_set1_epi8(-1));
+		}
+		}
+	}
+
+	template<u8 TClass>
+	TINY_TARGET_SSE2 static u32 scan_sse2(const char* p)
+	{
+		auto offset = static_cast<u32>(reinterpret_cast<uintptr_t>(p) & 15);
+		auto block = p - offset;
+
+		// One bit per byte that is not part of the class, bytes in front of p are ignored
+		auto v = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+		auto mask = ~static_cast<u32>(_mm_movemask_epi8(classify_sse2<TClass>(v))) & (0xFFFFu << offset) & 0xFFFFu;
+
+		while (mask == 0)
+		{
+			block += 16;
+			v = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+			mask = ~static_cast<u32>(_mm_movemask_epi8(classify_sse2<TClass>(v))) & 0xFFFFu;
+		}
+
+		return static_cast<u32>(block + llvm::countTrailingZeros(mask) - p);
+	}
+
+	TINY_TARGET_AVX2 static inline __m256i in_range_avx2(__m256i v, char lo, char hi)
+	{
+		auto shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - lo)));
+		return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + (hi - lo) + 1)), shifted);
+	}
+
+	template<u8 TClass>
+	TINY_TARGET_AVX2 static inline __m256i classify_avx2(__m256i v)
+	{
+		switch (TClass)
+		{
+		case Identifier: {
+			auto alpha = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+			auto digit = in_range_avx2(v, '0', '9');
+			auto underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+			return _mm256_or_si256(_mm256_or_si256(alpha, digit), underscore);
+		}
+		case Digit:
+			return in_range_avx2(v, '0', '9');
+		case Whitespace: {
+			auto space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+			auto control = in_range_avx2(v, '\t', '\r');
+			auto new_line = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+			return _mm256_or_si256(space, _mm256_andnot_si256(new_line, control));
+		}
+		default: {
+			auto quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+			auto sentinel = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+			return _mm256_xor_si256(_mm256_or_si256(quote, sentinel), _mm256_set1_epi8(-1));
+		}
+		}
+	}
+
+	template<u8 TClass>
+	TINY_TARGET_AVX2 static u32 scan_avx2(const char* p)
+	{
+		auto offset = static_cast<u32>(reinterpret_cast<uintptr_t>(p) & 31);
+		auto block = p - offset;
+
+		auto v = _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+		auto mask = ~static_cast<u32>(_mm256_movemask_epi8(classify_avx2<TClass>(v))) & (0xFFFFFFFFu << offset);
+
+		while (mask == 0)
+		{
+			block += 32;
+			v = _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+			mask = ~static_cast<u32>(_mm256_movemask_epi8(classify_avx2<TClass>(v)));
+		}
+
+		return static_cast<u32>(block + llvm::countTrailingZeros(mask) - p);
+	}
+
+#endif
+
+	static CharScanner select_char_scanner()
+	{
+#ifdef TINY_SCANNER_X86
+		llvm::StringMap<bool> features;
+		if (llvm::sys::getHostCPUFeatures(features))
+		{
+			if (features.lookup("avx2"))
+				return CharScanner{ scan_avx2<Identifier>, scan_avx2<Digit>, scan_avx2<Whitespace>, scan_avx2<StringBody> };
+
+			if (features.lookup("sse2"))
+				return CharScanner{ scan_sse2<Identifier>, scan_sse2<Digit>, scan_sse2<Whitespace>, scan_sse2<StringBody> };
+		}
+#endif
+
+		return CharScanner{ scan_scalar<Identifier>, scan_scalar<Digit>, scan_scalar<Whitespace>, scan_scalar<StringBody> };
+	}
+
+	const CharScanner& get_char_scanner()
+	{
+		static const CharScanner scanner = select_char_scanner();
+		return scanner;
+	}
+
+}
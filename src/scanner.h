@@ -0,0 +1,22 @@
+#pragma once
+
+#include "type.h"
+
+namespace tiny {
+
+	// Each function returns the length of the run of characters of its class starting at p.
+	// The input has to be terminated by a '\0' sentinel, which is never part of any class.
+	struct CharScanner
+	{
+		u32(*identifier)(const char* p);
+		u32(*digits)(const char* p);
+		// Whitespace except '\n', the Lexer handles new lines itself to keep track of line numbers
+		u32(*whitespace)(const char* p);
+		// Everything up to the closing '"' or the sentinel
+		u32(*string_body)(const char* p);
+	};
+
+	// Returns the AVX2, SSE2 or scalar implementation depending on what the CPU supports
+	const CharScanner& get_char_scanner();
+
+}
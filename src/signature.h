@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "type.h"
+
+namespace tiny {
+
+	struct FnSignature
+	{
+		Type return_type;
+		std::vector<Type> args;
+
+		bool operator==(const FnSignature& other) const
+		{
+			return return_type == other.return_type && args == other.args;
+		}
+
+		bool operator!=(const FnSignature& other) const
+		{
+			return !(*this == other);
+		}
+
+		std::string get_name() const
+		{
+			std::string name = "(";
+			for (size_t i = 0; i < args.size(); i++)
+			{
+				if (i > 0)
+					name += ", ";
+
+				name += get_type_name(args[i]);
+			}
+
+			return name + ") -> " + get_type_name(return_type);
+		}
+	};
+
+	// The tiny type a C++ type is passed as, only the types tiny can declare are defined
+	template<class T>
+	struct NativeType;
+
+	template<> struct NativeType<void> { static const Type value = Type::Void; };
+	template<> struct NativeType<i32> { static const Type value = Type::I32; };
+	template<> struct NativeType<i32*> { static const Type value = Type::I32Ptr; };
+	template<> struct NativeType<const i32*> { static const Type value = Type::I32Ptr; };
+	template<> struct NativeType<i8> { static const Type value = Type::I8; };
+	template<> struct NativeType<i8*> { static const Type value = Type::I8Ptr; };
+	template<> struct NativeType<const i8*> { static const Type value = Type::I8Ptr; };
+	template<> struct NativeType<char*> { static const Type value = Type::I8Ptr; };
+	template<> struct NativeType<const char*> { static const Type value = Type::I8Ptr; };
+
+	template<class TSignature>
+	struct NativeSignature;
+
+	template<class TReturn, class... TArgs>
+	struct NativeSignature<TReturn(TArgs...)>
+	{
+		static FnSignature get()
+		{
+			return FnSignature{ NativeType<TReturn>::value, { NativeType<TArgs>::value... } };
+		}
+	};
+
+	// Name of the wrapper CodeGen emits for a function that only takes and returns scalars. The wrapper stores
+	// fn(args[0][i], args[1][i], ...) to out[i] for every i below count.
+	inline std::string get_batch_function_name(const std::string& name)
+	{
+		return name + ".batch";
+	}
+
+	template<class TSignature>
+	struct BatchSignature;
+
+	// The pointers are declared noalias, out must not overlap any of the inputs
+	template<class TReturn, class... TArgs>
+	struct BatchSignature<TReturn(TArgs...)>
+	{
+		typedef void Type(i32 count, const TArgs*... args, TReturn* out);
+	};
+
+}
@@ -0,0 +1,307 @@
+#include "stress.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <thread>
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "fold.h"
+#include "jit.h"
+#include "parser.h"
+#include "tiny_exception.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__)
+#include <cstdio>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tiny {
+
+	// Passes over all loaded programs per round whose instruction TLB misses are counted, calling into many small
+	// modules is where the pool is meant to help
+	static const u32 call_passes = 1000;
+
+	struct ResidentSize
+	{
+		size_t current;
+		size_t peak;
+	};
+
+	// Both are 0 where the OS does not report them
+	static ResidentSize get_resident_size()
+	{
+		ResidentSize size = {};
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			size.current = counters.WorkingSetSize;
+			size.peak = counters.PeakWorkingSetSize;
+		}
+#elif defined(__linux__)
+		// The second field of statm is the resident size in pages
+		if (auto file = fopen("/proc/self/statm", "r"))
+		{
+			unsigned long pages, resident;
+			if (fscanf(file, "%lu %lu", &pages, &resident) == 2)
+				size.current = resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			fclose(file);
+		}
+
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+			size.peak = static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+		return size;
+	}
+
+	// Instruction TLB misses of the calling thread in user mode. Only Linux exposes the counter to a process, and
+	// only if the CPU (or the hypervisor) has one.
+	class ITLBMissCounter
+	{
+	public:
+		ITLBMissCounter() : fd_(-1)
+		{
+#if defined(__linux__)
+			perf_event_attr attributes = {};
+			attributes.size = sizeof(attributes);
+			attributes.type = PERF_TYPE_HW_CACHE;
+			attributes.config = PERF_COUNT_HW_CACHE_ITLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			attributes.disabled = 1;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+		}
+
+		ITLBMissCounter(const ITLBMissCounter&) = delete;
+		ITLBMissCounter& operator=(const ITLBMissCounter&) = delete;
+
+		~ITLBMissCounter()
+		{
+#if defined(__linux__)
+			if (fd_ >= 0)
+				close(fd_);
+#endif
+		}
+
+		bool is_available() const
+		{
+			return fd_ >= 0;
+		}
+
+		void start()
+		{
+#if defined(__linux__)
+			if (fd_ >= 0)
+				ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+		}
+
+		void stop()
+		{
+#if defined(__linux__)
+			if (fd_ >= 0)
+				ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+		}
+
+		// Misses counted between all start and stop calls so far
+		u64 get_count() const
+		{
+			u64 count = 0;
+#if defined(__linux__)
+			if (fd_ >= 0 && read(fd_, &count, sizeof(count)) != sizeof(count))
+				count = 0;
+#endif
+			return count;
+		}
+
+	private:
+		int fd_;
+	};
+
+	// Every program defines the same functions, the value main returns tells whose code ran
+	static std::string generate_program(u32 index)
+	{
+		auto n = std::to_string(index);
+		return "fn add(x i32, y i32) -> i32 {\n\tret x + y + " + n + "\n}\n\nfn main() -> i32 {\n\tret add(" + n + ", 1)\n}\n";
+	}
+
+	static i32 get_expected_result(u32 index)
+	{
+		return static_cast<i32>(2 * index + 1);
+	}
+
+	static std::unique_ptr<llvm::MemoryBuffer> compile_program(u32 index, OptLevel level)
+	{
+		auto name = "stress" + std::to_string(index) + ".tiny";
+
+		Interner interner;
+		Parser parser(std::make_unique<Lexer>(llvm::MemoryBuffer::getMemBufferCopy(generate_program(index), name), &interner));
+		auto ast = parser.parse();
+		fold_constants(ast.get());
+
+		std::unique_ptr<llvm::TargetMachine> tm(llvm::EngineBuilder().setOptLevel(get_codegen_opt_level(level)).selectTarget());
+		llvm::LLVMContext context;
+
+		CodeGen codegen(context, tm.get(), level);
+		auto module = codegen.execute(ast.get());
+
+		// Kept as a plain buffer so every round can link a fresh copy
+		auto object = llvm::orc::SimpleCompiler(*tm)(*module);
+		return llvm::MemoryBuffer::getMemBufferCopy(object.getBinary()->getData(), name);
+	}
+
+	static std::vector<std::unique_ptr<llvm::MemoryBuffer>> compile_programs(u32 count, OptLevel level)
+	{
+		std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects(count);
+		std::vector<std::exception_ptr> errors(count);
+
+		std::vector<std::thread> threads;
+		for (u32 i = 0; i < count; i++)
+		{
+			threads.push_back(std::thread([=, &objects, &errors]() {
+				try
+				{
+					objects[i] = compile_program(i, level);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			}));
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		for (auto& error : errors)
+		{
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		return objects;
+	}
+
+	void run_stress_test(u32 count, u32 rounds, OptLevel level, MemoryPool* pool)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		auto objects = compile_programs(count, level);
+		auto compiled = std::chrono::high_resolution_clock::now();
+
+		std::unique_ptr<llvm::TargetMachine> tm(llvm::EngineBuilder().setOptLevel(get_codegen_opt_level(level)).selectTarget());
+		OrcJit jit(*tm);
+		if (pool)
+			jit.set_memory_pool(pool);
+
+		size_t peak_code_size = 0;
+		size_t peak_mapped_size = 0;
+		size_t mapped_baseline = 0;
+
+		ITLBMissCounter itlb_misses;
+		std::chrono::duration<double, std::nano> call_time(0);
+
+		std::vector<ModuleHandle> handles;
+		std::vector<i32(*)()> mains(count);
+		for (u32 round = 0; round < rounds; round++)
+		{
+			for (auto& object : objects)
+			{
+				auto handle = jit.add_object(llvm::MemoryBuffer::getMemBufferCopy(object->getBuffer(), object->getBufferIdentifier()));
+				jit.add_signature(handle, "main", NativeSignature<i32()>::get());
+				handles.push_back(handle);
+			}
+
+			for (u32 i = 0; i < count; i++)
+			{
+				mains[i] = jit.get_function_ptr<i32()>(handles[i], "main");
+
+				auto result = mains[i]();
+				if (result != get_expected_result(i))
+				{
+					throw TinyException("Program " + std::to_string(i) + " returned " + std::to_string(result) + " in round " + std::to_string(round) +
+						", expected " + std::to_string(get_expected_result(i)));
+				}
+			}
+
+			// The sum keeps the calls from being dropped, the results were checked above
+			i32 sum = 0;
+			auto calls_started = std::chrono::high_resolution_clock::now();
+			itlb_misses.start();
+
+			for (u32 pass = 0; pass < call_passes; pass++)
+			{
+				for (auto main : mains)
+					sum += main();
+			}
+
+			itlb_misses.stop();
+			call_time += std::chrono::high_resolution_clock::now() - calls_started;
+
+			if (sum == 0)
+				throw TinyException("The programs returned nothing in round " + std::to_string(round));
+
+			peak_code_size = std::max(peak_code_size, jit.get_code_size());
+			if (pool)
+				peak_mapped_size = std::max(peak_mapped_size, pool->get_mapped_size());
+
+			for (auto handle : handles)
+				jit.remove_module(handle);
+
+			handles.clear();
+
+			if (jit.get_code_size() != 0)
+				throw TinyException(std::to_string(jit.get_code_size()) + " bytes of code are still allocated after round " + std::to_string(round));
+
+			if (!pool)
+				continue;
+
+			// The pool keeps the slabs it allocates from, so whatever it holds after the first round is the baseline
+			auto mapped_size = pool->get_mapped_size();
+			if (round == 0)
+				mapped_baseline = mapped_size;
+			else if (mapped_size != mapped_baseline)
+				throw TinyException("The memory pool holds " + std::to_string(mapped_size) + " bytes after round " + std::to_string(round) + ", expected " + std::to_string(mapped_baseline));
+		}
+
+		auto finished = std::chrono::high_resolution_clock::now();
+
+		llvm::outs() << "stress: compiled " << count << " programs on " << count << " threads in " << std::chrono::duration<double, std::milli>(compiled - start).count() << " ms\n";
+		llvm::outs() << "stress: " << rounds << " rounds of add, run and remove in " << std::chrono::duration<double, std::milli>(finished - compiled).count() << " ms\n";
+		llvm::outs() << "stress: peak code size " << peak_code_size << " bytes";
+		if (pool)
+			llvm::outs() << ", peak pool size " << peak_mapped_size << " bytes, baseline " << mapped_baseline << " bytes";
+		llvm::outs() << "\n";
+
+		auto calls = static_cast<double>(count) * call_passes * rounds;
+		llvm::outs() << "stress: " << llvm::format("%.2f", call_time.count() / calls) << " ns per call to main, instruction TLB misses per 1000 calls: ";
+		if (itlb_misses.is_available())
+			llvm::outs() << llvm::format("%.2f", itlb_misses.get_count() * 1000.0 / calls) << "\n";
+		else
+			llvm::outs() << "not available\n";
+
+		auto resident = get_resident_size();
+		llvm::outs() << "stress: resident size " << resident.current / 1024 << " KiB, peak " << resident.peak / 1024 << " KiB\n";
+	}
+
+}
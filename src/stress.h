@@ -0,0 +1,15 @@
+#pragma once
+
+#include "codegen.h"
+#include "memory_pool.h"
+
+namespace tiny {
+
+	// Compiles count generated programs on count threads, then adds all of them to one OrcJit, runs them and removes
+	// them again, rounds times. Every program defines main, so they are told apart by their module handles. Throws a
+	// TinyException if a program returns the wrong value or a round does not give back all of its memory. pool may
+	// be nullptr. Prints the time per call to main, instruction TLB misses where they can be counted and the
+	// resident size of the process, to compare runs with and without the pool.
+	void run_stress_test(u32 count, u32 rounds, OptLevel level, MemoryPool* pool);
+
+}
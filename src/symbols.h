@@ -1,67 +1,99 @@
 #pragma once
 
-#include <unordered_map>
+#include <vector>
+
+#include "interner.h"
 
 namespace tiny {
 
 	template<class TValue>
 	struct Symbol
 	{
-		Symbol(const std::string& n, std::unique_ptr<TValue> v) : name(n), value(std::move(v)) {}
-		std::string name;
-		std::unique_ptr<TValue> value;
+		Symbol(SymbolId n, TValue v, u32 s) : name(n), value(v), shadowed(s) {}
+		SymbolId name;
+		TValue value;
+		// Index of the entry with the same name this one hides, no_entry if there is none
+		u32 shadowed;
 	};
 
+	// One flat table for every nested scope. Entries are appended to a single array and each SymbolId keeps the index
+	// of its innermost entry, so a lookup is two array reads. Popping a scope unwinds the entries added since the
+	// matching push and restores the ones they were hiding. Entries added with add_root_entry live in a separate table
+	// that is not affected by scopes.
 	template<class TValue>
 	class SymbolTable
 	{
 	public:
-		SymbolTable(SymbolTable* parent) : parent_(parent) {}
+		void push_scope()
+		{
+			scopes_.push_back(static_cast<u32>(entries_.size()));
+		}
 
-		bool has_entry(const std::string& name) const
+		void pop_scope()
 		{
-			auto it = symbols_.find(name);
-			if (it != symbols_.end())
+			auto marker = scopes_.back();
+			scopes_.pop_back();
+
+			while (entries_.size() > marker)
 			{
-				return true;
+				const auto& entry = entries_.back();
+				heads_[entry.name] = entry.shadowed;
+				entries_.pop_back();
 			}
+		}
+
+		// The innermost visible entry or nullptr, the pointer is only valid until the next add or pop
+		const Symbol<TValue>* get_entry(SymbolId name) const
+		{
+			if (name < heads_.size() && heads_[name] != no_entry)
+				return &entries_[heads_[name]];
 
-			if (parent_ != nullptr)
-				return parent_->has_entry(name);
+			if (name < root_heads_.size() && root_heads_[name] != no_entry)
+				return &root_entries_[root_heads_[name]];
 
-			return false;
+			return nullptr;
 		}
 
-		const Symbol<TValue>* get_entry(const std::string& name) const
+		// Only looks at the entries added with add_root_entry
+		const Symbol<TValue>* get_root_entry(SymbolId name) const
 		{
-			auto it = symbols_.find(name);
-			if (it != symbols_.end())
-			{
-				return it->second.get();
-			}
-
-			if (parent_ != nullptr)
-				return parent_->get_entry(name);
+			if (name < root_heads_.size() && root_heads_[name] != no_entry)
+				return &root_entries_[root_heads_[name]];
 
 			return nullptr;
 		}
 
-		void add_entry(const std::string& name, std::unique_ptr<TValue> v)
+		void add_entry(SymbolId name, TValue v)
 		{
-			symbols_.insert(std::make_pair(name, std::make_unique<Symbol<TValue>>(name, std::move(v))));
+			if (name >= heads_.size())
+				heads_.resize(name + 1, no_entry);
+
+			entries_.push_back(Symbol<TValue>(name, v, heads_[name]));
+			heads_[name] = static_cast<u32>(entries_.size() - 1);
 		}
 
-		void add_root_entry(const std::string& name, std::unique_ptr<TValue> v)
+		void add_root_entry(SymbolId name, TValue v)
 		{
-			if (parent_ != nullptr)
-				return parent_->add_root_entry(name, std::move(v));
+			if (name >= root_heads_.size())
+				root_heads_.resize(name + 1, no_entry);
 
-			add_entry(name, std::move(v));
+			root_entries_.push_back(Symbol<TValue>(name, v, root_heads_[name]));
+			root_heads_[name] = static_cast<u32>(root_entries_.size() - 1);
 		}
 
 	private:
-		SymbolTable* parent_;
-		std::unordered_map<std::string, std::unique_ptr<Symbol<TValue>>> symbols_;
+		static const u32 no_entry = ~0u;
+
+		std::vector<Symbol<TValue>> entries_;
+		// Indexed by SymbolId
+		std::vector<u32> heads_;
+		// Size of entries_ when each open scope was pushed
+		std::vector<u32> scopes_;
+		std::vector<Symbol<TValue>> root_entries_;
+		std::vector<u32> root_heads_;
 	};
 
-}
\ No newline at end of file
+	template<class TValue>
+	const u32 SymbolTable<TValue>::no_entry;
+
+}
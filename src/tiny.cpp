@@ -4,41 +4,332 @@
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <llvm/IR/Verifier.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
 #include "type.h"
 #include "tiny_exception.h"
 #include "parser.h"
 #include "codegen.h"
+#include "fold.h"
 #include "jit.h"
+#include "aot.h"
+#include "bench.h"
+#include "object_cache.h"
+#include "parallel_codegen.h"
+#include "stress.h"
 
 using namespace tiny;
 
+struct Options
+{
+	Options() : path("test_files/test.tiny"), level(OptLevel::O0), lazy(false), time(false), batch(false), pool(false), huge_pages(false), threads(1), stress(0), stress_rounds(8), bench_ast(0), bench_codegen(0) {}
+
+	std::string path;
+	OptLevel level;
+	bool lazy;
+	bool time;
+	// Emit batch wrappers for scalar functions
+	bool batch;
+	// Allocate JIT code from a shared MemoryPool, optionally backed by huge pages
+	bool pool;
+	bool huge_pages;
+	// Number of threads generating and compiling functions
+	u32 threads;
+	// Number of generated programs the stress test runs, 0 runs the program at path instead
+	u32 stress;
+	// Add, run and remove cycles of the stress test
+	u32 stress_rounds;
+	// Number of nodes in the program -bench-ast generates, 0 if the benchmark is not run
+	u32 bench_ast;
+	// Number of functions in the program -bench-codegen generates, compiled with up to threads threads
+	u32 bench_codegen;
+	// Empty if caching is disabled
+	std::string cache_directory;
+	// Set for ahead of time compilation, the program is not run then
+	std::string object_path;
+	std::string assembly_path;
+	std::string bitcode_path;
+	std::string executable_path;
+
+	bool is_aot() const
+	{
+		return !object_path.empty() || !assembly_path.empty() || !bitcode_path.empty() || !executable_path.empty();
+	}
+};
+
+// tiny [-O0|-O1|-O2|-O3] [-lazy] [-cache <directory>] [-batch] [-pool] [-huge-pages] [-time] [file]
+// tiny [-O0|-O1|-O2|-O3] [-threads <count>] [-batch] [-pool] [-huge-pages] [-time] [file]
+// tiny [-O0|-O1|-O2|-O3] [-stress <count>] [-rounds <count>] [-pool] [-huge-pages]
+// tiny -bench-ast <nodes>
+// tiny [-O0|-O1|-O2|-O3] [-threads <count>] -bench-codegen <functions>
+// tiny [-O0|-O1|-O2|-O3] [-emit-obj <file>] [-emit-asm <file>] [-emit-bc <file>] [-exe <file>] [file]
+static Options parse_options(int argc, char* argv[])
+{
+	Options options;
+
+	for (auto i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3')
+			options.level = static_cast<OptLevel>(arg[2] - '0');
+		else if (arg == "-lazy")
+			options.lazy = true;
+		else if (arg == "-time")
+			options.time = true;
+		else if (arg == "-batch")
+			options.batch = true;
+		else if (arg == "-pool")
+			options.pool = true;
+		else if (arg == "-huge-pages")
+			options.pool = options.huge_pages = true;
+		else if (arg == "-cache" && i + 1 < argc)
+			options.cache_directory = argv[++i];
+		else if (arg == "-emit-obj" && i + 1 < argc)
+			options.object_path = argv[++i];
+		else if (arg == "-emit-asm" && i + 1 < argc)
+			options.assembly_path = argv[++i];
+		else if (arg == "-emit-bc" && i + 1 < argc)
+			options.bitcode_path = argv[++i];
+		else if (arg == "-exe" && i + 1 < argc)
+			options.executable_path = argv[++i];
+		else if (arg == "-threads" && i + 1 < argc)
+			options.threads = static_cast<u32>(std::max(1, atoi(argv[++i])));
+		else if (arg == "-stress" && i + 1 < argc)
+			options.stress = static_cast<u32>(std::max(1, atoi(argv[++i])));
+		else if (arg == "-rounds" && i + 1 < argc)
+			options.stress_rounds = static_cast<u32>(std::max(1, atoi(argv[++i])));
+		else if (arg == "-bench-ast" && i + 1 < argc)
+			options.bench_ast = static_cast<u32>(std::max(1, atoi(argv[++i])));
+		else if (arg == "-bench-codegen" && i + 1 < argc)
+			options.bench_codegen = static_cast<u32>(std::max(1, atoi(argv[++i])));
+		else if (arg[0] == '-')
+			throw TinyException("Unknown option: " + arg);
+		else
+			options.path = arg;
+	}
+
+	if (options.lazy && !OrcJit::is_lazy_supported(llvm::Triple(llvm::sys::getProcessTriple())))
+		throw TinyException("-lazy is only supported on x86_64 Linux and macOS, this is " + llvm::sys::getProcessTriple());
+
+	if (options.stress != 0 && (options.lazy || !options.cache_directory.empty() || options.is_aot() || options.threads > 1))
+		throw TinyException("-stress can not be combined with -lazy, -cache, -threads or ahead of time compilation");
+
+	if (options.threads > 1 && (options.lazy || !options.cache_directory.empty() || options.is_aot()))
+		throw TinyException("-threads can not be combined with -lazy, -cache or ahead of time compilation");
+
+	return options;
+}
+
+// Objects carry no type information, the parallel path and cache hits hand the declared signatures to the JIT
+static void add_signatures(OrcJit* jit, ModuleHandle handle, const AST* ast)
+{
+	for (auto node : ast->nodes)
+	{
+		if (node->node_type() != NodeType::FnDeclaration)
+			continue;
+
+		auto fn = static_cast<FnDeclaration*>(node);
+		if (fn->external)
+			continue;
+
+		FnSignature signature;
+		signature.return_type = fn->return_type->type;
+		for (auto arg : fn->args)
+			signature.args.push_back(arg->type->type);
+
+		jit->add_signature(handle, ast->interner->get(fn->name), std::move(signature));
+	}
+}
+
+static std::unique_ptr<AST> build_ast(std::unique_ptr<llvm::MemoryBuffer> source, Interner* interner)
+{
+	auto p = std::make_unique<Parser>(std::make_unique<Lexer>(std::move(source), interner));
+
+	auto ast = p->parse();
+	fold_constants(ast.get());
+
+	return ast;
+}
+
+static std::unique_ptr<llvm::Module> build_module(const Options& options, std::unique_ptr<llvm::MemoryBuffer> source, llvm::TargetMachine* tm, llvm::LLVMContext& context)
+{
+	auto interner = std::make_unique<Interner>();
+	auto ast = build_ast(std::move(source), interner.get());
+
+	auto codegen = std::make_unique<CodeGen>(context, tm, options.level);
+	codegen->set_batch_functions(options.batch);
+	auto module = codegen->execute(ast.get());
+
+	if (llvm::verifyModule(*module, &llvm::errs()))
+		throw TinyException("Invalid module generated for " + options.path);
+
+	return module;
+}
+
+static void compile_ahead_of_time(const Options& options)
+{
+	// Unlike the JIT target the output is linked by the system linker, which expects position independent code
+	auto tm = llvm::EngineBuilder().setRelocationModel(llvm::Reloc::PIC_).setCodeModel(llvm::CodeModel::Small).setOptLevel(get_codegen_opt_level(options.level)).selectTarget();
+	llvm::LLVMContext context;
+	auto module = build_module(options, Lexer::open_source(options.path), tm, context);
+
+	// The codegen passes behind assembly and object output rewrite the IR, so bitcode is written before either of
+	// them runs and each of them gets a copy of its own
+	if (!options.bitcode_path.empty())
+		emit_file(*module, *tm, options.bitcode_path, OutputKind::Bitcode);
+
+	if (!options.assembly_path.empty())
+		emit_file(*llvm::CloneModule(module.get()), *tm, options.assembly_path, OutputKind::Assembly);
+
+	if (options.object_path.empty() && options.executable_path.empty())
+		return;
+
+	// Linking without -emit-obj goes through an object next to the executable that is removed afterwards
+	auto object_path = options.object_path.empty() ? options.executable_path + ".o" : options.object_path;
+	emit_file(*llvm::CloneModule(module.get()), *tm, object_path, OutputKind::Object);
+
+	if (options.executable_path.empty())
+		return;
+
+	link_executable(object_path, options.executable_path);
+
+	if (options.object_path.empty())
+		llvm::sys::fs::remove(object_path);
+}
+
 int main(int argc, char* argv[])
 {
 	try
 	{
+		auto start = std::chrono::high_resolution_clock::now();
+		auto options = parse_options(argc, argv);
+
 		llvm::InitializeNativeTarget();
 		llvm::InitializeNativeTargetAsmPrinter();
 		llvm::InitializeNativeTargetAsmParser();
-		
-		auto tm = llvm::EngineBuilder().selectTarget();
 
-		auto p = std::make_unique<Parser>(std::make_unique<Lexer>("test_files/test.tiny"));
+		if (options.stress != 0)
+		{
+			std::unique_ptr<MemoryPool> pool;
+			if (options.pool)
+				pool = std::make_unique<MemoryPool>(MemoryPool::default_slab_size, options.huge_pages);
+
+			run_stress_test(options.stress, options.stress_rounds, options.level, pool.get());
+			llvm::llvm_shutdown();
+			return 0;
+		}
 
-		auto ast = p->parse();
+		if (options.bench_ast != 0)
+		{
+			run_ast_benchmark(options.bench_ast);
+			llvm::llvm_shutdown();
+			return 0;
+		}
 
-		auto codegen = std::make_unique<CodeGen>(tm);
-		auto module = codegen->execute(ast.get());
+		if (options.bench_codegen != 0)
+		{
+			run_codegen_benchmark(options.bench_codegen, options.level, options.threads);
+			llvm::llvm_shutdown();
+			return 0;
+		}
+
+		if (options.is_aot())
+		{
+			compile_ahead_of_time(options);
+			llvm::llvm_shutdown();
+			return 0;
+		}
 		
-		llvm::verifyModule(*module);
+		auto tm = llvm::EngineBuilder().setOptLevel(get_codegen_opt_level(options.level)).selectTarget();
+
+		// Declared before the JIT, it has to outlive the modules allocated from it
+		std::unique_ptr<MemoryPool> pool;
+		auto jit = std::make_unique<OrcJit>(*tm, options.lazy);
+		if (options.pool)
+		{
+			pool = std::make_unique<MemoryPool>(MemoryPool::default_slab_size, options.huge_pages);
+			jit->set_memory_pool(pool.get());
+		}
+
+		// The lazy layer compiles one function at a time, so there is no whole module object to cache
+		std::unique_ptr<ObjectCache> cache;
+		std::unique_ptr<llvm::MemoryBuffer> object;
+		std::string key;
+		auto cache_hit = false;
 
-		module->dump();
+		// Read once, so the cache key is computed from exactly the text the Lexer gets even if the file changes
+		auto source = Lexer::open_source(options.path);
 
-		auto jit = std::make_unique<OrcJit>(*tm);
-		jit->add_module(std::move(module));
+		if (!options.cache_directory.empty() && !options.lazy)
+		{
+			key = ObjectCache::get_key(source->getBuffer(), options.level, options.batch, *tm);
+			cache = std::make_unique<ObjectCache>(options.cache_directory);
+			jit->set_object_cache(cache.get());
+			object = cache->load(key);
+			cache_hit = object != nullptr;
+		}
+
+		ModuleHandle cached_module = 0;
+		if (cache_hit)
+		{
+			try
+			{
+				cached_module = jit->add_object(std::move(object));
+			}
+			catch (TinyException&)
+			{
+				// A truncated or corrupt entry is compiled again, which also overwrites it
+				llvm::errs() << "Ignoring unreadable cache entry " << key << "\n";
+				cache->remove(key);
+				cache_hit = false;
+			}
+		}
+
+		if (cache_hit)
+		{
+			// The object carries no types, the front end is cheap enough to run again just for the signatures
+			auto interner = std::make_unique<Interner>();
+			auto ast = build_ast(std::move(source), interner.get());
+			add_signatures(jit.get(), cached_module, ast.get());
+		}
+		else if (options.threads > 1)
+		{
+			auto interner = std::make_unique<Interner>();
+			auto ast = build_ast(std::move(source), interner.get());
+
+			for (auto& compiled : compile_parallel(ast.get(), options.level, options.threads, options.batch))
+				add_signatures(jit.get(), jit->add_object(std::move(compiled)), ast.get());
+		}
+		else
+		{
+			auto context = std::make_unique<llvm::LLVMContext>();
+			auto module = build_module(options, std::move(source), tm, *context);
+			module->dump();
+
+			if (cache)
+				module->setModuleIdentifier(ObjectCache::get_module_identifier(key));
+
+			jit->add_module(std::move(module), std::move(context));
+		}
 
 		auto main_ptr = jit->get_function_ptr<i32()>("main");
+
+		if (options.time)
+		{
+			auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start);
+			llvm::outs() << "startup: " << elapsed.count() << " ms";
+			if (cache)
+				llvm::outs() << (cache_hit ? " (cache hit)" : " (cache miss)");
+			llvm::outs() << "\n";
+		}
 		
 		llvm::outs() << "\n";
 		llvm::outs() << "main returns: ";
@@ -18,7 +18,8 @@ namespace tiny
 			va_start(args, fmt);
 
 			char b[1024];
-			sprintf_s(b, 1024, fmt, args);
+			vsprintf_s(b, 1024, fmt, args);
+			va_end(args);
 			message_ = std::string(b);
 		}
 
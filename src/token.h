@@ -1,6 +1,12 @@
 #pragma once
 
+#include <vector>
+#include <algorithm>
+
+#include "llvm/ADT/StringRef.h"
+
 #include "type.h"
+#include "interner.h"
 
 namespace tiny {
 
@@ -31,6 +37,9 @@ namespace tiny {
 		I8
 	};
 
+	// Size of the tables indexed by TokenType, has to follow the last entry above
+	const u16 token_type_count = static_cast<u16>(TokenType::I8) + 1;
+
 	enum class Precedence : u16
 	{
 		Assignment = 1,			// =, +=, -=, /=, :=
@@ -66,14 +75,52 @@ namespace tiny {
 
 	struct Token
 	{
-		Token::Token(TokenType token_type, const std::string& token_value, const std::string& file, u32 line, u32 start_col, u32 end_col) : type(token_type), value(token_value), line_number(line), start_column(start_col), end_column(end_col), file_name(file) {}
+		Token::Token(TokenType token_type, llvm::StringRef token_value, u32 file, u32 line, u32 start_col, u32 end_col) : type(token_type), value(token_value), line_number(line), start_column(start_col), end_column(end_col), file_id(file) {}
 
 		TokenType type;
-		std::string value;
+		// A view into the source buffer owned by the Lexer, only valid while the Lexer is alive
+		llvm::StringRef value;
 		u32 line_number;
 		u32 start_column;
 		u32 end_column;
-		std::string file_name;
+		// Index into the Lexer's file table, see Lexer::get_file_name
+		u32 file_id;
+	};
+
+	// A whole file lexed up front and stored as parallel arrays, one entry per token
+	struct TokenStream
+	{
+		std::vector<TokenType> kinds;
+		std::vector<u32> offsets;
+		std::vector<u32> lengths;
+		// The interned name of every identifier token, unused for all other kinds
+		std::vector<SymbolId> symbols;
+		// Offset of the first character of every line, line and column numbers are only computed for diagnostics
+		std::vector<u32> line_offsets;
+		const char* source;
+		u32 file_id;
+
+		u32 size() const
+		{
+			return static_cast<u32>(kinds.size());
+		}
+
+		llvm::StringRef value(u32 index) const
+		{
+			return llvm::StringRef(source + offsets[index], lengths[index]);
+		}
+
+		u32 line_number(u32 index) const
+		{
+			return static_cast<u32>(std::upper_bound(line_offsets.begin(), line_offsets.end(), offsets[index]) - line_offsets.begin());
+		}
+
+		u32 column(u32 index) const
+		{
+			// String literal values start after the opening quote
+			auto offset = kinds[index] == TokenType::StringLiteral ? offsets[index] - 1 : offsets[index];
+			return offset - line_offsets[line_number(index) - 1] + 1;
+		}
 	};
 
 }
\ No newline at end of file
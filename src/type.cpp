@@ -31,21 +31,57 @@ namespace tiny {
 		}
 	}
 
-	std::unique_ptr<TinyType> get_type_from_token(TokenType t, bool pointer)
+	Type get_type_from_token(TokenType t, bool pointer)
 	{
 		switch (t)
 		{
 		case TokenType::Fn:
-			return std::make_unique<TinyType>(Type::Fn);
+			return Type::Fn;
 		case TokenType::IntLiteral:
 		case TokenType::I32:
-			return std::make_unique<TinyType>(pointer ? Type::I32Ptr : Type::I32);
+			return pointer ? Type::I32Ptr : Type::I32;
 		case TokenType::I8:
-			return std::make_unique<TinyType>(pointer ? Type::I8Ptr : Type::I8);
+			return pointer ? Type::I8Ptr : Type::I8;
 		case TokenType::StringLiteral:
-			return std::make_unique<TinyType>(Type::StringLit);
+			return Type::StringLit;
 		default:
 			throw TinyException("get_type_from_token -> default case");
 		}
 	}
-}
+
+	TypeContext::TypeContext()
+	{
+		add(Type::Unresolved, nullptr);
+		add(Type::Void, nullptr);
+		add(Type::UserDefined, nullptr);
+		add(Type::Fn, nullptr);
+		auto i32 = add(Type::I32, nullptr);
+		pointer_types_[i32] = add(Type::I32Ptr, i32);
+		auto i8 = add(Type::I8, nullptr);
+		pointer_types_[i8] = add(Type::I8Ptr, i8);
+		add(Type::StringLit, nullptr);
+	}
+
+	const TinyType* TypeContext::get(Type t) const
+	{
+		return types_[static_cast<u16>(t)].get();
+	}
+
+	const TinyType* TypeContext::get_pointer(const TinyType* element) const
+	{
+		auto it = pointer_types_.find(element);
+		if (it != pointer_types_.end())
+			return it->second;
+
+		throw TinyException("TypeContext::get_pointer -> unsupported element type");
+	}
+
+	const TinyType* TypeContext::add(Type t, const TinyType* element)
+	{
+		if (types_.size() != static_cast<u16>(t))
+			throw TinyException("TypeContext::add -> types have to be added in declaration order");
+
+		types_.push_back(std::make_unique<TinyType>(t, element));
+		return types_.back().get();
+	}
+}
\ No newline at end of file
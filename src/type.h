@@ -3,9 +3,14 @@
 #include <stdint.h>
 #include <string>
 #include <memory>
+#include <vector>
+#include <unordered_map>
 
 #include "tiny_exception.h"
 
+typedef int8_t i8;
+typedef uint8_t u8;
+
 typedef int16_t i16;
 typedef uint16_t u16;
 
@@ -34,18 +39,25 @@ namespace tiny {
 	};
 
 	std::string get_type_name(Type t);
-	std::unique_ptr<TinyType> get_type_from_token(TokenType t, bool pointer);
+	Type get_type_from_token(TokenType t, bool pointer);
 
+	// Only ever created by a TypeContext, which hands out one canonical instance per type
 	struct TinyType
 	{
-		TinyType(Type t) : type(t), name(get_type_name(t)) {}
+		TinyType(Type t, const TinyType* e) : type(t), element(e) {}
 
 		Type type;
-		std::string name;
+		// The pointee of pointer types, nullptr for everything else
+		const TinyType* element;
+
+		std::string get_name() const
+		{
+			return get_type_name(type);
+		}
 
 		bool operator==(const TinyType& other) const
 		{
-			return this->type == other.type && this->name == other.name;
+			return this == &other;
 		}
 
 		bool are_equal(const TinyType* other) const
@@ -57,4 +69,22 @@ namespace tiny {
 		}
 	};
 
+	class TypeContext
+	{
+	public:
+		TypeContext();
+		TypeContext(const TypeContext&) = delete;
+		TypeContext& operator=(const TypeContext&) = delete;
+
+		const TinyType* get(Type t) const;
+		const TinyType* get_pointer(const TinyType* element) const;
+
+	private:
+		const TinyType* add(Type t, const TinyType* element);
+
+		// Indexed by Type
+		std::vector<std::unique_ptr<TinyType>> types_;
+		std::unordered_map<const TinyType*, const TinyType*> pointer_types_;
+	};
+
 }
\ No newline at end of file